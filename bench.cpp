@@ -27,13 +27,78 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include <atomic>
 #include <iostream>
 #include <list>
+#include <map>
 #include <nlohmann/json.hpp>
+#include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// allocations counter: malloc family is replaced on glibc to count rapidjson allocations too, elsewhere only
+// operator new is counted
+std::atomic<uint64_t> allocations_count{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) noexcept {
+  allocations_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) noexcept {
+  allocations_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+void* realloc(void* pointer, size_t size) noexcept {
+  allocations_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(pointer, size);
+}
+}
+#else
+void* operator new(size_t size) {
+  allocations_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+#endif
+
+// reports allocations per iteration of the benchmark loop as "allocs" counter
+class AllocationsCounter final {
+ public:
+  explicit AllocationsCounter(benchmark::State& state) : state_(state), start_(allocations_count.load()) {}
+  ~AllocationsCounter() {
+    state_.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations_count.load() - start_),
+                                                   benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  benchmark::State& state_;
+  const uint64_t start_;
+};
+
 static void RapidJsonWriter_CreateJson(benchmark::State& state) {
   // Perform setup here
   std::string string_field_name1("field_name1");
@@ -56,6 +121,7 @@ static void RapidJsonWriter_CreateJson(benchmark::State& state) {
   double double_value = 1.1;
   float float_value = 2.2f;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
     // This code gets timed
     rapidjson::StringBuffer string_buffer;
@@ -147,11 +213,36 @@ static void RapidJsonWriter_CreateJson(benchmark::State& state) {
   // std::cout << "test hash: " << uint64_value << std::endl;
 }
 
-static void RapidBuilder_CreateJson(benchmark::State& state) {
-  // Perform setup here
-  std::string string_field_name1("field_name1");
-  std::string string_field_name2("field_name2");
-  std::string string_field_value("field_valuefield_valuefield_valuefield_valuefield_valuefield_valuefield_value");
+// message of the CreateJson and CreateDocument benchmarks, the variants differ only in the measured call
+struct MessagePayload {
+  // message built from the payload, build gets it as the json::build argument
+  template <typename Builder>
+  auto Build(Builder&& build) {
+    return build({{string_field_name1, "value"},
+                  {"field_name", string_field_value},
+                  {string_field_name2, string_field_value},
+                  {"obj", {{"some", "other"}, {"int", 0}}},
+                  {"from vector", json::array(values)},
+                  {"int64_t", int64_value},
+                  {"uint64_t", uint64_value},
+                  {"int32_t", int32_value},
+                  {"uint32_t", uint32_value},
+                  {"int16_t", int16_value},
+                  {"uint16_t", uint16_value},
+                  {"char", char_value},
+                  {"uchar", uchar_value},
+                  {"double", double_value},
+                  {"float", float_value},
+                  {"l", -123l},
+                  {"ul", 123ul},
+                  {"ll", -123ll},
+                  {"ull", 123ull},
+                  {"bool", true}});
+  }
+
+  std::string string_field_name1{"field_name1"};
+  std::string string_field_name2{"field_name2"};
+  std::string string_field_value{"field_valuefield_valuefield_valuefield_valuefield_valuefield_valuefield_value"};
 
   std::vector<int64_t> values{1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5,
                               1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5,
@@ -161,6 +252,7 @@ static void RapidBuilder_CreateJson(benchmark::State& state) {
   unsigned char uchar_value = 'F' + 128;
   uint16_t uint16_value = 0xFFFF;
   uint32_t uint32_value = 0xFFFFFFFF;
+  // also the hash of the results, so builds are not optimized out
   uint64_t uint64_value = 0xFFFFFFFFFFFFFFFF;
   char char_value = 'F';
   int16_t int16_value = -32767;
@@ -168,35 +260,856 @@ static void RapidBuilder_CreateJson(benchmark::State& state) {
   int64_t int64_value = 0x8FFFFFFFFFFFFFF0;
   double double_value = 1.1;
   float float_value = 2.2f;
+};
 
+static void RapidBuilder_CreateJson(benchmark::State& state) {
+  MessagePayload payload;
+
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
-    // This code gets timed
+    const auto json_text =
+        payload.Build([](const json::builder::value_holder& message) { return json::build(message); });
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
 
-    const auto json_text = json::build({{string_field_name1, "value"},
-                                        {"field_name", string_field_value},
-                                        {string_field_name2, string_field_value},
-                                        {"obj", {{"some", "other"}, {"int", 0}}},
-                                        {"from vector", json::array(values)},
-                                        {"int64_t", int64_value},
-                                        {"uint64_t", uint64_value},
-                                        {"int32_t", int32_value},
-                                        {"uint32_t", uint32_value},
-                                        {"int16_t", int16_value},
-                                        {"uint16_t", uint16_value},
-                                        {"char", char_value},
-                                        {"uchar", uchar_value},
-                                        {"double", double_value},
-                                        {"float", float_value},
-                                        {"l", -123l},
-                                        {"ul", 123ul},
-                                        {"ll", -123ll},
-                                        {"ull", 123ull},
-                                        {"bool", true}});
-    uint64_value += json_text.size();
-    // std::cout << json_text << std::endl;
+static void RapidBuilder_CreateJsonNoContext(benchmark::State& state) {
+  MessagePayload payload;
+  // fresh buffers and writer for every build
+  json::build_options options;
+  options.thread_context = false;
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text =
+        payload.Build([&](const json::builder::value_holder& message) { return json::build(message, options); });
+    payload.uint64_value += json_text.size();
   }
-  // std::cout << "test hash: " << uint64_value << std::endl;
-  benchmark::DoNotOptimize(uint64_value);
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+static void RapidBuilder_CreateJsonContext(benchmark::State& state) {
+  MessagePayload payload;
+  // json is built in the context buffer
+  json::build_context context;
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text =
+        payload.Build([&](const json::builder::value_holder& message) { return context.build(message); });
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+static void RapidBuilder_CreateJsonInto(benchmark::State& state) {
+  MessagePayload payload;
+  // output storage reused between iterations
+  std::string json_text;
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    payload.Build([&](const json::builder::value_holder& message) { json::build_into(json_text, message); });
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+static void RapidBuilder_CreateJsonBuffer(benchmark::State& state) {
+  MessagePayload payload;
+  // output buffer reused between iterations
+  rapidjson::StringBuffer buffer;
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text =
+        payload.Build([&](const json::builder::value_holder& message) { return json::build(buffer, message); });
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+static void RapidBuilder_CreateJsonShape(benchmark::State& state) {
+  namespace shape = json::shape;
+  // keys, nested constant object and constant values are joined at compile time
+  static constexpr auto kShape = shape::compile(shape::object(shape::field("field_name1", "value"),
+                                                              shape::field("field_name", shape::slot),
+                                                              shape::field("field_name2", shape::slot),
+                                                              shape::field("obj",
+                                                                           shape::object(shape::field("some", "other"),
+                                                                                         shape::field("int", 0))),
+                                                              shape::field("from vector", shape::slot),
+                                                              shape::field("int64_t", shape::slot),
+                                                              shape::field("uint64_t", shape::slot),
+                                                              shape::field("int32_t", shape::slot),
+                                                              shape::field("uint32_t", shape::slot),
+                                                              shape::field("int16_t", shape::slot),
+                                                              shape::field("uint16_t", shape::slot),
+                                                              shape::field("char", shape::slot),
+                                                              shape::field("uchar", shape::slot),
+                                                              shape::field("double", shape::slot),
+                                                              shape::field("float", shape::slot),
+                                                              shape::field("l", -123l),
+                                                              shape::field("ul", 123ul),
+                                                              shape::field("ll", -123ll),
+                                                              shape::field("ull", 123ull),
+                                                              shape::field("bool", true)));
+  MessagePayload payload;
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text = kShape.build(payload.string_field_value,
+                                        payload.string_field_value,
+                                        json::numbers(payload.values),
+                                        payload.int64_value,
+                                        payload.uint64_value,
+                                        payload.int32_value,
+                                        payload.uint32_value,
+                                        payload.int16_value,
+                                        payload.uint16_value,
+                                        payload.char_value,
+                                        payload.uchar_value,
+                                        payload.double_value,
+                                        payload.float_value);
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+static void RapidBuilder_CreateJsonPrepared(benchmark::State& state) {
+  MessagePayload payload;
+  // schema with runtime keys is prepared once
+  const auto prepared = json::prepare({{payload.string_field_name1, "value"},
+                                       {"field_name", json::placeholder(0)},
+                                       {payload.string_field_name2, json::placeholder(0)},
+                                       {"obj", {{"some", "other"}, {"int", 0}}},
+                                       {"from vector", json::placeholder(1)},
+                                       {"int64_t", json::placeholder(2)},
+                                       {"uint64_t", json::placeholder(3)},
+                                       {"int32_t", json::placeholder(4)},
+                                       {"uint32_t", json::placeholder(5)},
+                                       {"int16_t", json::placeholder(6)},
+                                       {"uint16_t", json::placeholder(7)},
+                                       {"char", json::placeholder(8)},
+                                       {"uchar", json::placeholder(9)},
+                                       {"double", json::placeholder(10)},
+                                       {"float", json::placeholder(11)},
+                                       {"l", -123l},
+                                       {"ul", 123ul},
+                                       {"ll", -123ll},
+                                       {"ull", 123ull},
+                                       {"bool", true}});
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text = prepared.build(payload.string_field_value,
+                                          json::numbers(payload.values),
+                                          payload.int64_value,
+                                          payload.uint64_value,
+                                          payload.int32_value,
+                                          payload.uint32_value,
+                                          payload.int16_value,
+                                          payload.uint16_value,
+                                          payload.char_value,
+                                          payload.uchar_value,
+                                          payload.double_value,
+                                          payload.float_value);
+    payload.uint64_value += json_text.size();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
+
+// payload with state.range(0) records: strings, numbers and nested objects, from ~200 bytes to several MB
+struct SizedPayload {
+  explicit SizedPayload(const size_t records) {
+    names.reserve(records);
+    for (size_t index = 0; index < records; ++index) {
+      names.emplace_back("record name " + std::to_string(index));
+      values.emplace_back(static_cast<int64_t>(index * 7919));
+      doubles.emplace_back(static_cast<double>(index) / 3.0);
+    }
+  }
+
+  std::string description{"payload with \"quotes\" and \\ escapes"};
+  std::vector<std::string> names;
+  std::vector<int64_t> values;
+  std::vector<double> doubles;
+};
+
+static void RapidBuilder_BuildGrowth(benchmark::State& state) {
+  const SizedPayload payload(static_cast<size_t>(state.range(0)));
+  uint64_t total_size = 0;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text = json::build({{"description", payload.description},
+                                        {"names", json::array(payload.names)},
+                                        {"values", json::array(payload.values)},
+                                        {"doubles", json::array(payload.doubles)}});
+    total_size += json_text.size();
+  }
+  benchmark::DoNotOptimize(total_size);
+}
+
+static void RapidBuilder_BuildExactSize(benchmark::State& state) {
+  const SizedPayload payload(static_cast<size_t>(state.range(0)));
+  uint64_t total_size = 0;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_text = json::build({{"description", payload.description},
+                                        {"names", json::array(payload.names)},
+                                        {"values", json::array(payload.values)},
+                                        {"doubles", json::array(payload.doubles)}},
+                                       {true});
+    total_size += json_text.size();
+  }
+  benchmark::DoNotOptimize(total_size);
+}
+
+static void RapidBuilder_Measure(benchmark::State& state) {
+  const SizedPayload payload(static_cast<size_t>(state.range(0)));
+  uint64_t total_size = 0;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    total_size += json::measure({{"description", payload.description},
+                                 {"names", json::array(payload.names)},
+                                 {"values", json::array(payload.values)},
+                                 {"doubles", json::array(payload.doubles)}});
+  }
+  benchmark::DoNotOptimize(total_size);
+}
+
+static void RapidBuilder_ArrayFromContainer(benchmark::State& state) {
+  std::vector<int64_t> values(static_cast<size_t>(state.range(0)));
+  for (size_t index = 0; index < values.size(); ++index) {
+    values[index] = static_cast<int64_t>(index);
+  }
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, {{"values", json::array(values)}});
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_ArrayFromRange(benchmark::State& state) {
+  std::vector<int64_t> values(static_cast<size_t>(state.range(0)));
+  for (size_t index = 0; index < values.size(); ++index) {
+    values[index] = static_cast<int64_t>(index);
+  }
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, {{"values", json::range(values)}});
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// integers of all lengths, from 1 to 19 digits
+std::vector<int64_t> MakeNumbers(const size_t count) {
+  std::vector<int64_t> values(count);
+  uint64_t seed = 1;
+  for (size_t index = 0; index < count; ++index) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    values[index] = static_cast<int64_t>(seed >> (1 + seed % 63));
+  }
+  return values;
+}
+
+static void RapidBuilder_NumbersGeneric(benchmark::State& state) {
+  const auto values = MakeNumbers(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, json::array(values));
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_NumbersVectorized(benchmark::State& state) {
+  const auto values = MakeNumbers(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, json::numbers(values));
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// metric like doubles: values, ratios and timestamps with up to 17 significant digits
+std::vector<double> MakeDoubles(const size_t count) {
+  std::vector<double> values(count);
+  uint64_t seed = 1;
+  for (size_t index = 0; index < count; ++index) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    const double scale[] = {1e-3, 1.0, 1e3, 1e9};
+    values[index] = static_cast<double>(seed >> 11) / static_cast<double>(1ull << 53) * scale[seed % 4];
+  }
+  return values;
+}
+
+// range(0) is the float_mode
+json::float_format MakeFloatFormat(benchmark::State& state) {
+  const auto mode = static_cast<json::float_mode>(state.range(0));
+  const char* labels[] = {"standard", "shortest", "fixed(3)", "significant(6)"};
+  state.SetLabel(labels[state.range(0)]);
+  return {mode, json::float_mode::fixed == mode ? 3 : json::float_mode::significant == mode ? 6 : 0};
+}
+
+static void RapidJson_Doubles(benchmark::State& state) {
+  const auto values = MakeDoubles(10000);
+  rapidjson::StringBuffer buffer;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartArray();
+    for (const double value : values) {
+      writer.Double(value);
+    }
+    writer.EndArray();
+  }
+  benchmark::DoNotOptimize(buffer.GetSize());
+}
+
+static void RapidBuilder_Doubles(benchmark::State& state) {
+  const auto values = MakeDoubles(10000);
+  const json::build_options options{false, true, MakeFloatFormat(state)};
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, json::numbers(values), options);
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_DoublesObject(benchmark::State& state) {
+  const auto values = MakeDoubles(16);
+  const json::build_options options{false, true, MakeFloatFormat(state)};
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text,
+                     {{"cpu", values[0]},
+                      {"memory", values[1]},
+                      {"disk", values[2]},
+                      {"network", {{"in", values[3]}, {"out", values[4]}, {"errors", values[5]}}},
+                      {"latency",
+                       {{"p50", values[6]}, {"p90", values[7]}, {"p99", values[8]}, {"max", values[9]}}},
+                      {"load", json::array({values[10], values[11], values[12]})},
+                      {"rate", values[13]},
+                      {"ratio", values[14]},
+                      {"timestamp", values[15]}},
+                     options);
+  }
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// log lines of 2000 chars, range(0) percent of them must be escaped: quotes, backslashes and control chars
+std::vector<std::string> MakeLogLines(const int64_t escape_percent) {
+  const char specials[] = {'"', '\\', '\n', '\t', '\x01'};
+  std::vector<std::string> lines(100);
+  uint64_t seed = 1;
+  for (auto& line : lines) {
+    line.resize(2000);
+    for (auto& c : line) {
+      seed = seed * 6364136223846793005 + 1442695040888963407;
+      c = static_cast<int64_t>((seed >> 33) % 100) < escape_percent ? specials[(seed >> 13) % 5]
+                                                                      : static_cast<char>('a' + (seed >> 20) % 26);
+    }
+  }
+  return lines;
+}
+
+static void RapidJson_Strings(benchmark::State& state) {
+  const auto lines = MakeLogLines(state.range(0));
+  rapidjson::StringBuffer buffer;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartArray();
+    for (const auto& line : lines) {
+      writer.String(line.data(), static_cast<rapidjson::SizeType>(line.size()));
+    }
+    writer.EndArray();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * lines.size() * lines.front().size()));
+  benchmark::DoNotOptimize(buffer.GetSize());
+}
+
+static void RapidBuilder_Strings(benchmark::State& state) {
+  const auto lines = MakeLogLines(state.range(0));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, json::range(lines));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * lines.size() * lines.front().size()));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// [[...[1]...]] from the vectors, range(0) levels
+json::builder::value_holder MakeNestedArrays(const int64_t depth) {
+  std::optional<json::builder::array_holder> nested(std::in_place);
+  nested->emplace_back(1);
+  for (int64_t level = 1; level < depth; ++level) {
+    json::builder::array_holder parent;
+    parent.emplace_back(std::move(*nested));
+    nested.emplace(std::move(parent));
+  }
+  return json::builder::value_holder(std::move(*nested));
+}
+
+// range(0) arrays of 8 numbers each in the single array
+json::builder::value_holder MakeWideArrays(const int64_t width) {
+  json::builder::array_holder rows(static_cast<size_t>(width));
+  for (int64_t row = 0; row < width; ++row) {
+    json::builder::array_holder columns(8);
+    for (int64_t column = 0; column < 8; ++column) {
+      columns.emplace_back(row * 8 + column);
+    }
+    rows.emplace_back(std::move(columns));
+  }
+  return json::builder::value_holder(std::move(rows));
+}
+
+static void RapidBuilder_DeepNesting(benchmark::State& state) {
+  const auto value = MakeNestedArrays(state.range(0));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, value);
+  }
+  // time per item is the cost of one nesting level
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_DeepNestingDocument(benchmark::State& state) {
+  const auto value = MakeNestedArrays(state.range(0));
+  rapidjson::Document document;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_document(document, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(document.IsArray());
+}
+
+static void RapidBuilder_WideShallow(benchmark::State& state) {
+  const auto value = MakeWideArrays(state.range(0));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, value);
+  }
+  // time per item is the cost of one small array
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_WideShallowDocument(benchmark::State& state) {
+  const auto value = MakeWideArrays(state.range(0));
+  rapidjson::Document document;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_document(document, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(document.IsArray());
+}
+
+// mixed scalars: integers, booleans, short strings, doubles and nulls
+json::builder::value_holder MakeLargeArray(const size_t count) {
+  static const std::string strings[] = {"alpha", "beta", "gamma", "delta"};
+  json::builder::array_holder values(count);
+  for (size_t index = 0; index < count; ++index) {
+    switch (index % 5) {
+      case 0:
+        values.emplace_back(static_cast<int64_t>(index));
+        break;
+      case 1:
+        values.emplace_back(0 == index % 2);
+        break;
+      case 2:
+        values.emplace_back(strings[index % 4]);
+        break;
+      case 3:
+        values.emplace_back(static_cast<double>(index) / 8);
+        break;
+      default:
+        values.emplace_back(nullptr);
+    }
+  }
+  return json::builder::value_holder(std::move(values));
+}
+
+static void RapidBuilder_LargeArray(benchmark::State& state) {
+  const auto value = MakeLargeArray(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_into(json_text, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  // memory the walk goes through
+  state.counters["holder_bytes"] = static_cast<double>(sizeof(json::builder::value_holder) * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_LargeArrayDocument(benchmark::State& state) {
+  const auto value = MakeLargeArray(static_cast<size_t>(state.range(0)));
+  rapidjson::Document document;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_document(document, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(document.IsArray());
+}
+
+// same values as RapidBuilder_LargeArray, sizes of the binary output and of the json text
+static void RapidBuilder_LargeArrayMsgpack(benchmark::State& state) {
+  const auto value = MakeLargeArray(static_cast<size_t>(state.range(0)));
+  std::string bytes;
+  for (auto _ : state) {
+    json::build_msgpack_into(bytes, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["bytes"] = static_cast<double>(bytes.size());
+  state.counters["json_bytes"] = static_cast<double>(json::measure(value));
+}
+
+static void RapidBuilder_LargeArrayCbor(benchmark::State& state) {
+  const auto value = MakeLargeArray(static_cast<size_t>(state.range(0)));
+  std::string bytes;
+  for (auto _ : state) {
+    json::build_cbor_into(bytes, value);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["bytes"] = static_cast<double>(bytes.size());
+  state.counters["json_bytes"] = static_cast<double>(json::measure(value));
+}
+
+// range(0) threads write 1M values, 1 thread is the serial build
+static void RapidBuilder_ParallelLargeArray(benchmark::State& state) {
+  constexpr size_t kCount = 1000000;
+  const auto value = MakeLargeArray(kCount);
+  json::build_options options;
+  options.parallel_threads = static_cast<size_t>(state.range(0));
+  std::string json_text;
+  for (auto _ : state) {
+    json::build_into(json_text, value, options);
+  }
+  state.SetItemsProcessed(state.iterations() * kCount);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json_text.size()));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// small independent messages of the ingestion tick
+std::vector<json::builder::value_holder> MakeMessages(const size_t count) {
+  std::vector<json::builder::value_holder> messages;
+  messages.reserve(count);
+  for (size_t index = 0; index < count; ++index) {
+    messages.emplace_back(json::array(std::vector<json::builder::value_holder>{
+        "event", index, static_cast<double>(index) / 4, 0 == index % 2, "source-service"}));
+  }
+  return messages;
+}
+
+static void RapidBuilder_BuildLoop(benchmark::State& state) {
+  const auto messages = MakeMessages(10000);
+  for (auto _ : state) {
+    for (const auto& message : messages) {
+      benchmark::DoNotOptimize(json::build(message));
+    }
+  }
+  state.counters["messages"] =
+      benchmark::Counter(static_cast<double>(state.iterations() * messages.size()), benchmark::Counter::kIsRate);
+}
+
+// range(0) threads, 0 is all hardware threads
+static void RapidBuilder_BuildMany(benchmark::State& state) {
+  const auto messages = MakeMessages(10000);
+  json::build_batch batch;
+  for (auto _ : state) {
+    json::build_many_into(batch, messages.data(), messages.size(), {}, static_cast<size_t>(state.range(0)));
+  }
+  state.counters["messages"] =
+      benchmark::Counter(static_cast<double>(state.iterations() * messages.size()), benchmark::Counter::kIsRate);
+  benchmark::DoNotOptimize(batch.text.size());
+}
+
+struct BenchOrder {
+  int64_t id;
+  std::string customer;
+  double price;
+  uint32_t quantity;
+  bool paid;
+  std::vector<int32_t> items;
+};
+
+template <>
+struct json::describe<BenchOrder> {
+  static constexpr auto fields = std::make_tuple(json::member("id", &BenchOrder::id),
+                                                 json::member("customer", &BenchOrder::customer),
+                                                 json::member("price", &BenchOrder::price),
+                                                 json::member("quantity", &BenchOrder::quantity),
+                                                 json::member("paid", &BenchOrder::paid),
+                                                 json::member("items", &BenchOrder::items));
+};
+
+std::vector<BenchOrder> MakeOrders(const size_t count) {
+  std::vector<BenchOrder> orders;
+  orders.reserve(count);
+  for (size_t index = 0; index < count; ++index) {
+    orders.push_back({static_cast<int64_t>(index),
+                      "customer-" + std::to_string(index % 1000),
+                      static_cast<double>(index % 10000) / 100,
+                      static_cast<uint32_t>(index % 7 + 1),
+                      0 == index % 3,
+                      {static_cast<int32_t>(index), static_cast<int32_t>(index / 2)}});
+  }
+  return orders;
+}
+
+// rows written with rapidjson::Writer calls, keys are escaped on every row
+static void RapidJson_StructRows(benchmark::State& state) {
+  const auto orders = MakeOrders(static_cast<size_t>(state.range(0)));
+  rapidjson::StringBuffer buffer;
+  for (auto _ : state) {
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartArray();
+    for (const BenchOrder& order : orders) {
+      writer.StartObject();
+      writer.Key("id");
+      writer.Int64(order.id);
+      writer.Key("customer");
+      writer.String(order.customer.data(), static_cast<rapidjson::SizeType>(order.customer.size()));
+      writer.Key("price");
+      writer.Double(order.price);
+      writer.Key("quantity");
+      writer.Uint(order.quantity);
+      writer.Key("paid");
+      writer.Bool(order.paid);
+      writer.Key("items");
+      writer.StartArray();
+      for (const int32_t item : order.items) {
+        writer.Int(item);
+      }
+      writer.EndArray();
+      writer.EndObject();
+    }
+    writer.EndArray();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(buffer.GetSize());
+}
+
+// initializer list object per row, rows are joined to the array
+static void RapidBuilder_StructRowsPerObject(benchmark::State& state) {
+  const auto orders = MakeOrders(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  std::string row;
+  for (auto _ : state) {
+    json_text.assign(1, '[');
+    for (const BenchOrder& order : orders) {
+      json::build_into(row,
+                       {{"id", order.id},
+                        {"customer", order.customer},
+                        {"price", order.price},
+                        {"quantity", order.quantity},
+                        {"paid", order.paid},
+                        {"items", json::numbers(order.items)}});
+      if (json_text.size() > 1) {
+        json_text.push_back(',');
+      }
+      json_text.append(row);
+    }
+    json_text.push_back(']');
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// json::describe rows: one walk of the vector, keys are escaped at compile time
+static void RapidBuilder_StructRowsDescribed(benchmark::State& state) {
+  const auto orders = MakeOrders(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  for (auto _ : state) {
+    json::build_into(json_text, json::array(orders));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// count fields with string keys and values
+template <typename MAP>
+MAP MakeFieldsMap(const int64_t count) {
+  MAP fields;
+  for (int64_t index = 0; index < count; ++index) {
+    fields.emplace("field-" + std::to_string(index), std::to_string(index));
+  }
+  return fields;
+}
+
+// map written with rapidjson::Writer calls
+static void RapidJson_MapObject(benchmark::State& state) {
+  const auto fields = MakeFieldsMap<std::map<std::string, std::string>>(state.range(0));
+  rapidjson::StringBuffer buffer;
+  for (auto _ : state) {
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    for (const auto& field : fields) {
+      writer.Key(field.first.data(), static_cast<rapidjson::SizeType>(field.first.size()));
+      writer.String(field.second.data(), static_cast<rapidjson::SizeType>(field.second.size()));
+    }
+    writer.EndObject();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(buffer.GetSize());
+}
+
+static void RapidBuilder_MapObject(benchmark::State& state) {
+  const auto fields = MakeFieldsMap<std::map<std::string, std::string>>(state.range(0));
+  std::string json_text;
+  for (auto _ : state) {
+    json::build_into(json_text, json::object(fields));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// unordered map written with sorted keys, the pointers to the items are sorted on every build
+static void RapidBuilder_UnorderedMapSorted(benchmark::State& state) {
+  const auto fields = MakeFieldsMap<std::unordered_map<std::string, std::string>>(state.range(0));
+  std::string json_text;
+  for (auto _ : state) {
+    json::build_into(json_text, json::object(fields, json::key_order::sorted));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+static void RapidBuilder_MapDocument(benchmark::State& state) {
+  const auto fields = MakeFieldsMap<std::map<std::string, std::string>>(state.range(0));
+  rapidjson::Document document;
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    json::build_document(document, json::object(fields));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  benchmark::DoNotOptimize(document.IsObject());
+}
+
+// null device, so the benchmarks count the write calls but not the disk
+int NullDevice() {
+#ifdef _WIN32
+  static const int fd = _open("NUL", _O_WRONLY);
+#else
+  static const int fd = open("/dev/null", O_WRONLY);
+#endif
+  return fd;
+}
+
+// json::build per record, '\n' appended and written with own call
+static void RapidBuilder_LinesPerRecord(benchmark::State& state) {
+  const int fd = NullDevice();
+  int64_t records = 0;
+  for (auto _ : state) {
+    std::string line = json::build({{"event", "login"}, {"id", records}, {"ok", true}});
+    line.push_back('\n');
+#ifdef _WIN32
+    benchmark::DoNotOptimize(_write(fd, line.data(), static_cast<unsigned int>(line.size())));
+#else
+    benchmark::DoNotOptimize(write(fd, line.data(), line.size()));
+#endif
+    ++records;
+  }
+  state.SetItemsProcessed(records);
+}
+
+static void RapidBuilder_LinesWriter(benchmark::State& state) {
+  json::lines_writer writer(NullDevice());
+  int64_t records = 0;
+  for (auto _ : state) {
+    writer.write({{"event", "login"}, {"id", records}, {"ok", true}});
+    ++records;
+  }
+  writer.flush();
+  state.SetItemsProcessed(records);
+}
+
+// response of the upstream service with range(0) values
+std::string MakeFragment(const size_t count) {
+  return json::build(MakeLargeArray(count));
+}
+
+// fragment is parsed to the document and written again
+static void RapidJson_ReserializeFragment(benchmark::State& state) {
+  const std::string fragment = MakeFragment(static_cast<size_t>(state.range(0)));
+  rapidjson::StringBuffer buffer;
+  for (auto _ : state) {
+    rapidjson::Document document;
+    document.Parse(fragment.data(), fragment.size());
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key("id");
+    writer.Int(1);
+    writer.Key("payload");
+    document.Accept(writer);
+    writer.EndObject();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * fragment.size()));
+  benchmark::DoNotOptimize(buffer.GetSize());
+}
+
+static void RapidBuilder_RawFragment(benchmark::State& state) {
+  const std::string fragment = MakeFragment(static_cast<size_t>(state.range(0)));
+  std::string json_text;
+  for (auto _ : state) {
+    json::build_into(json_text, {{"id", 1}, {"payload", json::raw(fragment)}});
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * fragment.size()));
+  benchmark::DoNotOptimize(json_text.size());
+}
+
+// status document of 1000 services, range(0) percent of them change before every build, 100 rebuilds all of them
+static void RapidBuilder_CachedStatus(benchmark::State& state) {
+  constexpr size_t kServices = 1000;
+  const size_t churn = kServices * static_cast<size_t>(state.range(0)) / 100;
+  std::vector<std::string> names;
+  for (size_t index = 0; index < kServices; ++index) {
+    names.emplace_back("service-" + std::to_string(index));
+  }
+  std::vector<double> latencies(64);
+  for (size_t index = 0; index < latencies.size(); ++index) {
+    latencies[index] = static_cast<double>(index) / 8;
+  }
+  std::vector<uint64_t> versions(kServices, 0);
+  json::fragment_cache cache;
+  std::string json_text;
+  size_t next = 0;
+  for (auto _ : state) {
+    for (size_t count = 0; count < churn; ++count) {
+      ++versions[next];
+      next = (next + 1) % kServices;
+    }
+    const auto services = json::generate(kServices, [&](const size_t index) {
+      return json::cached(cache,
+                          names[index],
+                          versions[index],
+                          {{"name", names[index]}, {"version", versions[index]}, {"latency", json::numbers(latencies)}});
+    });
+    json::build_into(json_text, {{"services", services}});
+  }
+  state.counters["hit_rate"] = static_cast<double>(cache.hits()) / static_cast<double>(cache.hits() + cache.misses());
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json_text.size()));
+  benchmark::DoNotOptimize(json_text.size());
 }
 
 static void RapidJson_CreateJson(benchmark::State& state) {
@@ -221,6 +1134,7 @@ static void RapidJson_CreateJson(benchmark::State& state) {
   double double_value = 1.1;
   float float_value = 2.2f;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
     // This code gets timed
     rapidjson::Document document(rapidjson::kObjectType);
@@ -308,6 +1222,7 @@ static void Nlohmann_CreateJson(benchmark::State& state) {
   double double_value = 1.1;
   float float_value = 2.2f;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
     // This code gets timed
 
@@ -366,6 +1281,7 @@ static void RapidJson_CreateDocument(benchmark::State& state) {
   double double_value = 1.1;
   float float_value = 2.2f;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
     // This code gets timed
     rapidjson::Document document(rapidjson::kObjectType);
@@ -432,54 +1348,44 @@ static void RapidJson_CreateDocument(benchmark::State& state) {
 }
 
 static void RapidBuilder_CreateDocument(benchmark::State& state) {
-  // Perform setup here
-  std::string string_field_name1("field_name1");
-  std::string string_field_name2("field_name2");
-  std::string string_field_value("field_valuefield_valuefield_valuefield_valuefield_valuefield_valuefield_value");
+  MessagePayload payload;
 
-  std::vector<int64_t> values{1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5,
-                              1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5,
-                              1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5,
-                              1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5};
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    const auto json_document =
+        payload.Build([](const json::builder::value_holder& message) { return json::build_document(message); });
+    payload.uint64_value += json_document.MemberCount();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
 
-  unsigned char uchar_value = 'F' + 128;
-  uint16_t uint16_value = 0xFFFF;
-  uint32_t uint32_value = 0xFFFFFFFF;
-  uint64_t uint64_value = 0xFFFFFFFFFFFFFFFF;
-  char char_value = 'F';
-  int16_t int16_value = -32767;
-  int32_t int32_value = 0x8FFFFFF0;
-  int64_t int64_value = 0x8FFFFFFFFFFFFFF0;
-  double double_value = 1.1;
-  float float_value = 2.2f;
+static void RapidBuilder_CreateDocumentCopy(benchmark::State& state) {
+  MessagePayload payload;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
-    // This code gets timed
+    // all strings and keys are copied into the document
+    const auto json_document = payload.Build([](const json::builder::value_holder& message) {
+      return json::build_document(message, json::document_options{true});
+    });
+    payload.uint64_value += json_document.MemberCount();
+  }
+  benchmark::DoNotOptimize(payload.uint64_value);
+}
 
-    const auto json_document = json::build_document({{string_field_name1, "value"},
-                                                     {"field_name", string_field_value},
-                                                     {string_field_name2, string_field_value},
-                                                     {"obj", {{"some", "other"}, {"int", 0}}},
-                                                     {"from vector", json::array(values)},
-                                                     {"int64_t", int64_value},
-                                                     {"uint64_t", uint64_value},
-                                                     {"int32_t", int32_value},
-                                                     {"uint32_t", uint32_value},
-                                                     {"int16_t", int16_value},
-                                                     {"uint16_t", uint16_value},
-                                                     {"char", char_value},
-                                                     {"uchar", uchar_value},
-                                                     {"double", double_value},
-                                                     {"float", float_value},
-                                                     {"l", -123l},
-                                                     {"ul", 123ul},
-                                                     {"ll", -123ll},
-                                                     {"ull", 123ull},
-                                                     {"bool", true}});
-    uint64_value += json_document.MemberCount();
+static void RapidBuilder_CreateDocumentReuse(benchmark::State& state) {
+  MessagePayload payload;
+  // document over the user buffer, stack for the whole json is allocated once per build
+  static char buffer[64 * 1024];
+  rapidjson::MemoryPoolAllocator<> allocator(buffer, sizeof(buffer));
+  rapidjson::Document json_document(&allocator, 16 * 1024);
+
+  const AllocationsCounter allocations(state);
+  for (auto _ : state) {
+    payload.Build([&](const json::builder::value_holder& message) { json::build_document(json_document, message); });
+    payload.uint64_value += json_document.MemberCount();
   }
-  // std::cout << "test hash: " << uint64_value << std::endl;
-  benchmark::DoNotOptimize(uint64_value);
+  benchmark::DoNotOptimize(payload.uint64_value);
 }
 
 static void Nlohmann_CreateDocument(benchmark::State& state) {
@@ -502,6 +1408,7 @@ static void Nlohmann_CreateDocument(benchmark::State& state) {
   double double_value = 1.1;
   float float_value = 2.2f;
 
+  const AllocationsCounter allocations(state);
   for (auto _ : state) {
     // This code gets timed
 
@@ -544,6 +1451,88 @@ BENCHMARK(RapidJsonWriter_CreateJson);
 
 BENCHMARK(RapidBuilder_CreateJson);
 
+BENCHMARK(RapidBuilder_CreateJsonNoContext);
+
+BENCHMARK(RapidBuilder_CreateJsonContext);
+
+BENCHMARK(RapidBuilder_CreateJsonInto);
+
+BENCHMARK(RapidBuilder_CreateJsonBuffer);
+
+BENCHMARK(RapidBuilder_CreateJsonShape);
+
+BENCHMARK(RapidBuilder_CreateJsonPrepared);
+
+BENCHMARK(RapidBuilder_BuildGrowth)->Arg(4)->Arg(500)->Arg(100000);
+
+BENCHMARK(RapidBuilder_BuildExactSize)->Arg(4)->Arg(500)->Arg(100000);
+
+BENCHMARK(RapidBuilder_Measure)->Arg(4)->Arg(500)->Arg(100000);
+
+BENCHMARK(RapidBuilder_ArrayFromContainer)->Arg(1000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_ArrayFromRange)->Arg(1000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_NumbersGeneric)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+BENCHMARK(RapidBuilder_NumbersVectorized)->Arg(1000)->Arg(100000)->Arg(10000000);
+
+BENCHMARK(RapidJson_Strings)->Arg(0)->Arg(1)->Arg(5)->Arg(10);
+
+BENCHMARK(RapidBuilder_Strings)->Arg(0)->Arg(1)->Arg(5)->Arg(10);
+
+BENCHMARK(RapidBuilder_DeepNesting)->Arg(100)->Arg(10000);
+
+BENCHMARK(RapidBuilder_DeepNestingDocument)->Arg(100)->Arg(10000);
+
+BENCHMARK(RapidBuilder_WideShallow)->Arg(10000);
+
+BENCHMARK(RapidBuilder_WideShallowDocument)->Arg(10000);
+
+BENCHMARK(RapidBuilder_LargeArray)->Arg(100000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_LargeArrayDocument)->Arg(100000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_LargeArrayMsgpack)->Arg(100000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_LargeArrayCbor)->Arg(100000)->Arg(1000000);
+
+BENCHMARK(RapidBuilder_ParallelLargeArray)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+BENCHMARK(RapidBuilder_BuildLoop)->UseRealTime();
+
+BENCHMARK(RapidBuilder_BuildMany)->Arg(1)->Arg(4)->Arg(0)->UseRealTime();
+
+BENCHMARK(RapidJson_StructRows)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_StructRowsPerObject)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_StructRowsDescribed)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidJson_MapObject)->Arg(10)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_MapObject)->Arg(10)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_UnorderedMapSorted)->Arg(10)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_MapDocument)->Arg(10)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_LinesPerRecord);
+
+BENCHMARK(RapidBuilder_LinesWriter);
+
+BENCHMARK(RapidJson_ReserializeFragment)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_RawFragment)->Arg(1000)->Arg(100000);
+
+BENCHMARK(RapidBuilder_CachedStatus)->Arg(1)->Arg(10)->Arg(50)->Arg(100);
+
+BENCHMARK(RapidJson_Doubles);
+
+BENCHMARK(RapidBuilder_Doubles)->DenseRange(0, 3);
+
+BENCHMARK(RapidBuilder_DoublesObject)->DenseRange(0, 3);
+
 BENCHMARK(RapidJson_CreateJson);
 
 BENCHMARK(Nlohmann_CreateJson);
@@ -552,9 +1541,13 @@ BENCHMARK(RapidJson_CreateDocument);
 
 BENCHMARK(RapidBuilder_CreateDocument);
 
+BENCHMARK(RapidBuilder_CreateDocumentCopy);
+
+BENCHMARK(RapidBuilder_CreateDocumentReuse);
+
 BENCHMARK(Nlohmann_CreateDocument);
 
 
 
 // Run the benchmark
-BENCHMARK_MAIN();
\ No newline at end of file
+BENCHMARK_MAIN();
\ No newline at end of file
@@ -21,155 +21,2765 @@
 
 #include "builder.h"
 
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAPID_BUILDER_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// only if the whole build targets AVX2 (-mavx2, /arch:AVX2)
+#ifdef __AVX2__
+#define RAPID_BUILDER_AVX2 1
+#include <immintrin.h>
+#endif
+
 namespace json {
 namespace {
 
-template <typename Func>
-void ForEachArrayValue(const builder::array_holder& holder, Func&& func) {
-  if (builder::array_source::vector_t == holder.source) {
-    for (const auto& array_value : holder.items) {
-      func(array_value);
+/**
+ * \brief rapidjson output stream that writes straight into std::string, no intermediate buffer and final copy.
+ * String is grown in steps (reusing the existing capacity first) and trimmed to the written size on destruction
+ */
+class StringOutputStream final {
+ public:
+  typedef char Ch;
+
+  explicit StringOutputStream(std::string& output) noexcept : output_(output), size_(output.size()) {}
+  StringOutputStream(const StringOutputStream&) = delete;
+  StringOutputStream& operator=(const StringOutputStream&) = delete;
+  ~StringOutputStream() { output_.resize(size_); }
+
+  void Reserve(const size_t count) {
+    if (output_.size() - size_ < count) {
+      Grow(count);
+    }
+  }
+  void PutUnsafe(const Ch c) { output_[size_++] = c; }
+  void Put(const Ch c) {
+    Reserve(1);
+    PutUnsafe(c);
+  }
+  void Write(const Ch* data, const size_t count) {
+    Reserve(count);
+    std::memcpy(&output_[size_], data, count);
+    size_ += count;
+  }
+  void Flush() {}
+  size_t Size() const noexcept { return size_; }
+
+ private:
+  void Grow(const size_t count) {
+    const size_t required = size_ + count;
+    // use all the capacity that string already has, then grow geometrically
+    if (output_.capacity() >= required) {
+      output_.resize(output_.capacity());
+    } else {
+      output_.resize(std::max(std::max(output_.size() * 2, required), static_cast<size_t>(256)));
+    }
+  }
+
+  std::string& output_;
+  size_t size_;
+};
+
+// rapidjson::Writer picks these up via ADL to reserve once per token and write without per-char checks
+inline void PutReserve(StringOutputStream& stream, const size_t count) {
+  stream.Reserve(count);
+}
+inline void PutUnsafe(StringOutputStream& stream, const char c) {
+  stream.PutUnsafe(c);
+}
+
+/**
+ * \brief output stream for the pre-measured json: string is resized once to the exact json size. Every write is
+ * checked, so the output stays valid even if the measure is wrong
+ */
+class MeasuredStringOutputStream final {
+ public:
+  typedef char Ch;
+
+  MeasuredStringOutputStream(std::string& output, const size_t size) : output_(output), size_(output.size()) {
+    output_.resize(size_ + size);
+  }
+  MeasuredStringOutputStream(const MeasuredStringOutputStream&) = delete;
+  MeasuredStringOutputStream& operator=(const MeasuredStringOutputStream&) = delete;
+  ~MeasuredStringOutputStream() { output_.resize(size_); }
+
+  void Put(const Ch c) {
+    if (size_ == output_.size()) {
+      // never happens if measure is correct, keeps the output valid anyway
+      output_.resize(size_ * 2 + 1);
+    }
+    output_[size_++] = c;
+  }
+  void Write(const Ch* data, const size_t count) {
+    if (output_.size() - size_ < count) {
+      output_.resize(size_ * 2 + count);
+    }
+    std::memcpy(&output_[size_], data, count);
+    size_ += count;
+  }
+  void Flush() {}
+
+ private:
+  std::string& output_;
+  size_t size_;
+};
+
+/**
+ * \brief output stream with the fixed size chunk buffer, filled chunk is passed to the sink and reused. Long writes
+ * are split between chunks
+ */
+class ChunkOutputStream final {
+ public:
+  typedef char Ch;
+
+  ChunkOutputStream(const sink_function& sink, const size_t chunk_size) : sink_(sink), chunk_(chunk_size) {
+    RAPIDJSON_ASSERT(chunk_size > 0);
+    position_ = chunk_.data();
+    end_ = position_ + chunk_.size();
+  }
+  ChunkOutputStream(const ChunkOutputStream&) = delete;
+  ChunkOutputStream& operator=(const ChunkOutputStream&) = delete;
+  ~ChunkOutputStream() = default;
+
+  void Put(const Ch c) {
+    if (position_ == end_) {
+      Flush();
+    }
+    *position_++ = c;
+  }
+  void Write(const Ch* data, size_t count) {
+    while (count > 0) {
+      if (position_ == end_) {
+        Flush();
+      }
+      const size_t part = std::min(count, static_cast<size_t>(end_ - position_));
+      std::memcpy(position_, data, part);
+      position_ += part;
+      data += part;
+      count -= part;
+    }
+  }
+  void Flush() {
+    if (position_ != chunk_.data()) {
+      sink_(std::string_view(chunk_.data(), static_cast<size_t>(position_ - chunk_.data())));
+      position_ = chunk_.data();
+    }
+  }
+
+ private:
+  const sink_function& sink_;
+  std::vector<char> chunk_;
+  char* position_{nullptr};
+  char* end_{nullptr};
+};
+
+/**
+ * \brief string output stream for json::prepare, remembers where placeholder values go
+ */
+class TemplateOutputStream final {
+ public:
+  typedef char Ch;
+
+  explicit TemplateOutputStream(std::string& output) noexcept : stream_(output) {}
+  TemplateOutputStream(const TemplateOutputStream&) = delete;
+  TemplateOutputStream& operator=(const TemplateOutputStream&) = delete;
+  ~TemplateOutputStream() = default;
+
+  void Reserve(const size_t count) { stream_.Reserve(count); }
+  void PutUnsafe(const Ch c) { stream_.PutUnsafe(c); }
+  void Put(const Ch c) { stream_.Put(c); }
+  void Write(const Ch* data, const size_t count) { stream_.Write(data, count); }
+  void Flush() {}
+
+  void AddPlaceholder(const builder::placeholder_holder& placeholder) {
+    placeholders_.emplace_back(stream_.Size(), placeholder);
+  }
+  std::vector<std::pair<size_t, builder::placeholder_holder>> TakePlaceholders() noexcept {
+    return std::move(placeholders_);
+  }
+
+ private:
+  StringOutputStream stream_;
+  // text size where the placeholder value goes
+  std::vector<std::pair<size_t, builder::placeholder_holder>> placeholders_;
+};
+
+inline void PutReserve(TemplateOutputStream& stream, const size_t count) {
+  stream.Reserve(count);
+}
+inline void PutUnsafe(TemplateOutputStream& stream, const char c) {
+  stream.PutUnsafe(c);
+}
+
+constexpr char kPlaceholderError[] = "Failed: json::placeholder outside of json::prepare";
+
+// placeholders are formatted only by json::prepare
+template <typename Stream>
+void WritePlaceholder(Stream&, const builder::placeholder_holder&) {
+  throw std::runtime_error(kPlaceholderError);
+}
+
+inline void WritePlaceholder(TemplateOutputStream& stream, const builder::placeholder_holder& placeholder) {
+  // separator is written already, placeholder value goes right after it
+  stream.AddPlaceholder(placeholder);
+}
+
+// block writes of the formatted numbers, all our streams have Write, rapidjson buffer is written in place
+template <typename Stream>
+void WriteBlock(Stream& stream, const char* data, const size_t size) {
+  stream.Write(data, size);
+}
+inline void WriteBlock(rapidjson::StringBuffer& stream, const char* data, const size_t size) {
+  std::memcpy(stream.Push(size), data, size);
+}
+
+constexpr std::array<char, 200> kDigitPairs = [] {
+  std::array<char, 200> table{};
+  for (size_t value = 0; value < 100; ++value) {
+    table[value * 2] = static_cast<char>('0' + value / 10);
+    table[value * 2 + 1] = static_cast<char>('0' + value % 10);
+  }
+  return table;
+}();
+
+// two digits of value < 100
+inline char* WriteDigitPair(const uint32_t value, char* out) {
+  std::memcpy(out, &kDigitPairs[value * 2], 2);
+  return out + 2;
+}
+
+// 1 to 4 digits of value < 10000
+inline char* WriteSmallUnsigned(const uint32_t value, char* out) {
+  if (value < 10) {
+    *out = static_cast<char>('0' + value);
+    return out + 1;
+  }
+  if (value < 100) {
+    return WriteDigitPair(value, out);
+  }
+  if (value < 1000) {
+    *out = static_cast<char>('0' + value / 100);
+    return WriteDigitPair(value % 100, out + 1);
+  }
+  return WriteDigitPair(value % 100, WriteDigitPair(value / 100, out));
+}
+
+#ifdef RAPID_BUILDER_SSE2
+// 8 decimal digits of value < 10^8 as 16 bit lanes, division by the reciprocal multiplication in all lanes at once
+inline __m128i Convert8Digits(const uint32_t value) {
+  const __m128i div_10000 = _mm_set1_epi32(static_cast<int>(0xd1b71759));
+  const __m128i mul_10000 = _mm_set1_epi32(10000);
+  // 1/1000, 1/100, 1/10, 1 and the shifts of the fixed point reciprocals
+  const __m128i div_powers = _mm_setr_epi16(8389, 5243, 13108, -32768, 8389, 5243, 13108, -32768);
+  const __m128i shift_powers = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, -32768, 1 << 7, 1 << 11, 1 << 13, -32768);
+  // abcd, efgh = abcdefgh divmod 10000
+  const __m128i abcdefgh = _mm_cvtsi32_si128(static_cast<int>(value));
+  const __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, div_10000), 45);
+  const __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, mul_10000));
+  // [abcd * 4] x 4, [efgh * 4] x 4
+  const __m128i scaled = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+  const __m128i pairs = _mm_unpacklo_epi16(scaled, scaled);
+  const __m128i quads = _mm_unpacklo_epi32(pairs, pairs);
+  // a, ab, abc, abcd, e, ef, efg, efgh
+  const __m128i prefixes = _mm_mulhi_epu16(_mm_mulhi_epu16(quads, div_powers), shift_powers);
+  // a, b, c, d, e, f, g, h
+  const __m128i tens = _mm_mullo_epi16(prefixes, _mm_set1_epi16(10));
+  return _mm_sub_epi16(prefixes, _mm_slli_epi64(tens, 16));
+}
+
+inline unsigned CountTrailingZeros(const unsigned value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+}
+
+// 16 digits of the high and low 8 digit halves, leading zeros are skipped
+inline char* WriteDigits16(const __m128i high, const __m128i low, char* out) {
+  const __m128i ascii_zero = _mm_set1_epi8('0');
+  const __m128i digits = _mm_add_epi8(_mm_packus_epi16(high, low), ascii_zero);
+  const unsigned significant =
+      ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(digits, ascii_zero))) | 0x8000u;
+  const unsigned first = CountTrailingZeros(significant);
+  alignas(16) char buffer[16];
+  _mm_store_si128(reinterpret_cast<__m128i*>(buffer), digits);
+  std::memcpy(out, buffer + first, 16 - first);
+  return out + 16 - first;
+}
+#endif
+
+// same text as rapidjson::internal::u64toa, SSE2 converts 8 digits per step
+inline char* WriteUnsigned(const uint64_t value, char* out) {
+  if (value < 10000) {
+    return WriteSmallUnsigned(static_cast<uint32_t>(value), out);
+  }
+#ifdef RAPID_BUILDER_SSE2
+  constexpr uint64_t k8Digits = 100000000;
+  constexpr uint64_t k16Digits = k8Digits * k8Digits;
+  if (value < k8Digits) {
+    return WriteDigits16(_mm_setzero_si128(), Convert8Digits(static_cast<uint32_t>(value)), out);
+  }
+  if (value < k16Digits) {
+    return WriteDigits16(Convert8Digits(static_cast<uint32_t>(value / k8Digits)),
+                         Convert8Digits(static_cast<uint32_t>(value % k8Digits)),
+                         out);
+  }
+  // up to 4 leading digits and all 16 others
+  out = WriteSmallUnsigned(static_cast<uint32_t>(value / k16Digits), out);
+  const uint64_t low = value % k16Digits;
+  const __m128i digits = _mm_packus_epi16(Convert8Digits(static_cast<uint32_t>(low / k8Digits)),
+                                          Convert8Digits(static_cast<uint32_t>(low % k8Digits)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi8(digits, _mm_set1_epi8('0')));
+  return out + 16;
+#else
+  // two digits per step from the end
+  char buffer[20];
+  char* begin = buffer + sizeof(buffer);
+  uint64_t rest = value;
+  while (rest >= 100) {
+    begin -= 2;
+    WriteDigitPair(static_cast<uint32_t>(rest % 100), begin);
+    rest /= 100;
+  }
+  if (rest >= 10) {
+    begin -= 2;
+    WriteDigitPair(static_cast<uint32_t>(rest), begin);
+  } else {
+    *--begin = static_cast<char>('0' + rest);
+  }
+  const size_t length = static_cast<size_t>(buffer + sizeof(buffer) - begin);
+  std::memcpy(out, begin, length);
+  return out + length;
+#endif
+}
+
+// longest number text: shortest double representation, 24 chars
+constexpr size_t kMaxNumberLength = 25;
+
+// longest significant mode text: shortest double with all max precision digits
+constexpr size_t kMaxSignificantLength = kMaxNumberLength + float_format::max_precision;
+
+// longest floating point text: fixed mode, sign, 309 digits of the largest double, point and max precision decimals
+constexpr size_t kMaxFloatLength = 1 + 309 + 1 + float_format::max_precision;
+
+// longest text of the value in the format
+constexpr size_t MaxFloatLength(const float_format& format) noexcept {
+  return float_mode::fixed == format.mode ? kMaxFloatLength : kMaxSignificantLength;
+}
+
+// out must have MaxFloatLength(format) bytes
+template <typename T>
+char* WriteFloat(const T value, const float_format& format, char* out) {
+  // nan and inf have no json text, null keeps the json valid
+  if (!std::isfinite(value)) {
+    std::memcpy(out, "null", 4);
+    return out + 4;
+  }
+  std::to_chars_result result{};
+  switch (format.mode) {
+    case float_mode::standard:
+      return rapidjson::internal::dtoa(static_cast<double>(value), out);
+    case float_mode::shortest:
+      result = std::to_chars(out, out + kMaxNumberLength, value);
+      break;
+    case float_mode::fixed:
+      RAPIDJSON_ASSERT(format.precision >= 0 && format.precision <= float_format::max_precision);
+      result = std::to_chars(out, out + kMaxFloatLength, value, std::chars_format::fixed, format.precision);
+      break;
+    case float_mode::significant:
+      RAPIDJSON_ASSERT(format.precision >= 1 && format.precision <= float_format::max_precision);
+      result = std::to_chars(out, out + kMaxSignificantLength, value, std::chars_format::general, format.precision);
+      break;
+    default:
+      RAPIDJSON_ASSERT(false);
+  }
+  RAPIDJSON_ASSERT(std::errc() == result.ec);
+  return result.ptr;
+}
+
+template <typename T>
+char* WriteNumber(const T value, const float_format& floats, char* out) {
+  if constexpr (std::is_floating_point_v<T>) {
+    return WriteFloat(value, floats, out);
+  } else if constexpr (std::is_signed_v<T>) {
+    if (value < 0) {
+      *out = '-';
+      return WriteUnsigned(0 - static_cast<uint64_t>(value), out + 1);
+    }
+    return WriteUnsigned(static_cast<uint64_t>(value), out);
+  } else {
+    return WriteUnsigned(static_cast<uint64_t>(value), out);
+  }
+}
+
+// numbers are formatted into the stack block and the block is written to the stream at once
+template <typename Stream, typename T>
+void WriteNumbers(Stream& stream, const T* values, const size_t size, const float_format& floats) {
+  char block[2048];
+  // std::to_chars writes are not visible to the compiler, it warns about the uninitialized block otherwise
+  block[0] = 0;
+  // next number with the comma fits till the block end
+  const char* const last =
+      block + sizeof(block) - 1 - (std::is_floating_point_v<T> ? MaxFloatLength(floats) : kMaxNumberLength);
+  char* position = block;
+  for (size_t index = 0; index < size; ++index) {
+    if (position > last) {
+      WriteBlock(stream, block, static_cast<size_t>(position - block));
+      position = block;
+    }
+    if (index > 0) {
+      *position++ = ',';
+    }
+    position = WriteNumber(values[index], floats, position);
+  }
+  if (position != block) {
+    WriteBlock(stream, block, static_cast<size_t>(position - block));
+  }
+}
+
+// calls func with the typed pointer to the numeric array elements
+template <typename Func>
+void VisitNumbers(const builder::number_array_holder& holder, Func&& func) {
+  switch (holder.type) {
+    case builder::number_type::int8:
+      func(static_cast<const int8_t*>(holder.data));
+      break;
+    case builder::number_type::int16:
+      func(static_cast<const int16_t*>(holder.data));
+      break;
+    case builder::number_type::int32:
+      func(static_cast<const int32_t*>(holder.data));
+      break;
+    case builder::number_type::int64:
+      func(static_cast<const int64_t*>(holder.data));
+      break;
+    case builder::number_type::uint8:
+      func(static_cast<const uint8_t*>(holder.data));
+      break;
+    case builder::number_type::uint16:
+      func(static_cast<const uint16_t*>(holder.data));
+      break;
+    case builder::number_type::uint32:
+      func(static_cast<const uint32_t*>(holder.data));
+      break;
+    case builder::number_type::uint64:
+      func(static_cast<const uint64_t*>(holder.data));
+      break;
+    case builder::number_type::float32:
+      func(static_cast<const float*>(holder.data));
+      break;
+    case builder::number_type::float64:
+      func(static_cast<const double*>(holder.data));
+      break;
+    default:
+      RAPIDJSON_ASSERT(false);
+  }
+}
+
+// func returns false to stop the enumeration
+template <typename Func>
+void ForEachArrayValue(const builder::lazy_array_holder& holder, Func&& func) {
+  holder.for_each(
+      holder,
+      [](void* context, const builder::value_holder& array_value) {
+        return (*static_cast<std::remove_reference_t<Func>*>(context))(array_value);
+      },
+      const_cast<void*>(static_cast<const void*>(&func)));
+}
+
+// the field value is given to the func, it lives until the func returns
+template <typename Func>
+void VisitRecordField(const builder::record_holder& holder, const builder::record_field& field, Func&& func) {
+  field.visit(
+      holder.object,
+      [](void* context, const builder::value_holder& field_value) {
+        (*static_cast<std::remove_reference_t<Func>*>(context))(field_value);
+        return true;
+      },
+      const_cast<void*>(static_cast<const void*>(&func)));
+}
+
+// func returns false to stop the enumeration
+template <typename Func>
+void ForEachObjectField(const builder::lazy_object_holder& holder, Func&& func) {
+  holder.for_each(
+      holder,
+      [](void* context, const std::string_view name, const builder::value_holder& field_value) {
+        return (*static_cast<std::remove_reference_t<Func>*>(context))(name, field_value);
+      },
+      const_cast<void*>(static_cast<const void*>(&func)));
+}
+
+[[noreturn]] void ThrowDepthError() {
+  throw std::runtime_error("Failed: json nesting is deeper than max_depth");
+}
+
+/**
+ * \brief array or object that is walked right now: next field or item and the end of them
+ */
+struct TraversalFrame final {
+  // object fields, nullptr for arrays
+  const builder::field_holder* field;
+  const builder::field_holder* field_end;
+  // array items
+  const builder::value_holder* item;
+  const builder::value_holder* item_end;
+  size_t size;
+};
+
+// heap frames of the finished walk are swapped with the ones the thread keeps, so deep trees don't allocate the stack
+// on every build
+void SwapSpareFrames(std::unique_ptr<TraversalFrame[]>& frames, size_t& capacity) noexcept {
+  thread_local std::unique_ptr<TraversalFrame[]> spare_frames;
+  thread_local size_t spare_capacity = 0;
+  frames.swap(spare_frames);
+  std::swap(capacity, spare_capacity);
+}
+
+/**
+ * \brief explicit stack of the outer containers, usual depths fit the inline frames and deeper trees continue on the
+ * heap. max_depth 0 means no limit
+ */
+class TraversalStack final {
+ public:
+  explicit TraversalStack(const size_t max_depth) noexcept : max_depth_(max_depth) {}
+  TraversalStack(const TraversalStack&) = delete;
+  TraversalStack& operator=(const TraversalStack&) = delete;
+  ~TraversalStack() {
+    // same memory limit as the thread build_context has
+    if (nullptr != heap_ && capacity_ * sizeof(TraversalFrame) <= build_context::thread_capacity) {
+      SwapSpareFrames(heap_, capacity_);
+    }
+  }
+
+  // new container goes inside of depth containers
+  void Enter(const size_t depth) const {
+    if (0 != max_depth_ && depth >= max_depth_) {
+      ThrowDepthError();
+    }
+  }
+  void Push(const TraversalFrame& frame) {
+    if (size_ == capacity_) {
+      Grow();
+    }
+    frames_[size_++] = frame;
+  }
+  TraversalFrame Pop() noexcept { return frames_[--size_]; }
+  size_t Size() const noexcept { return size_; }
+
+ private:
+  static constexpr size_t kInlineFrames = 16;
+
+  void Grow() {
+    std::unique_ptr<TraversalFrame[]> frames;
+    size_t capacity = 0;
+    SwapSpareFrames(frames, capacity);
+    if (capacity <= capacity_) {
+      capacity = capacity_ * 2;
+      frames.reset(new TraversalFrame[capacity]);
+    }
+    std::copy(frames_, frames_ + size_, frames.get());
+    heap_ = std::move(frames);
+    frames_ = heap_.get();
+    capacity_ = capacity;
+  }
+
+  TraversalFrame inline_[kInlineFrames];
+  TraversalFrame* frames_{inline_};
+  size_t capacity_{kInlineFrames};
+  size_t size_{0};
+  std::unique_ptr<TraversalFrame[]> heap_;
+  const size_t max_depth_;
+};
+
+// scalar value or numeric array
+template <typename Handler>
+void WalkScalar(Handler& handler, const builder::value_holder& value) {
+  switch (value.type()) {
+    case builder::value_type::int64:
+      handler.Value(value.as_int64());
+      break;
+    case builder::value_type::uint64:
+      handler.Value(value.as_uint64());
+      break;
+    case builder::value_type::string:
+      handler.Value(value.as_string());
+      break;
+    case builder::value_type::float64:
+      handler.Value(value.as_double());
+      break;
+    case builder::value_type::boolean:
+      handler.Value(value.as_bool());
+      break;
+    case builder::value_type::null:
+      handler.Value(nullptr);
+      break;
+    case builder::value_type::number_array:
+      handler.Value(value.as_numbers());
+      break;
+    case builder::value_type::formatted_float:
+      handler.Value(value.as_float());
+      break;
+    case builder::value_type::placeholder:
+      handler.Value(value.as_placeholder());
+      break;
+    case builder::value_type::raw:
+      handler.Value(value.as_raw());
+      break;
+    default:
+      RAPIDJSON_ASSERT(false);
+  }
+}
+
+// handler that can stop the walk tells it with Stopped, the other ones are never stopped
+template <typename Handler>
+bool IsStopped(const Handler& handler) noexcept {
+  if constexpr (Handler::kStoppable) {
+    return handler.Stopped();
+  } else {
+    return false;
+  }
+}
+
+inline bool IsContainer(const builder::value_holder& value) noexcept {
+  const builder::value_type type = value.type();
+  return builder::value_type::object == type || builder::value_type::array == type ||
+         builder::value_type::lazy_array == type || builder::value_type::record == type ||
+         builder::value_type::lazy_object == type;
+}
+
+// walks the tree without recursion and gives the handler the SAX like events. Innermost container is kept in the
+// local frame, outer ones are on the stack, array items are walked in place until the nested container. Lazy arrays
+// enumerate their elements through the callback, so every element is walked by the nested call right away: only lazy
+// arrays take the native stack, one call per nesting level. Described structs and objects from containers are walked
+// the same way field by field, handlers that write json text take the struct keys escaped at compile time. Stopped
+// handler ends the walk right away, the stack is left as is then
+template <typename Handler>
+void WalkValue(Handler& handler, const builder::value_holder& root, TraversalStack& stack) {
+  // containers outside of this walk
+  const size_t base = stack.Size();
+  // containers of this walk, the innermost is top
+  size_t depth = 0;
+  TraversalFrame top{};
+  const builder::value_holder* value = &root;
+  while (true) {
+    switch (value->type()) {
+      case builder::value_type::object: {
+        const size_t size = value->size();
+        stack.Enter(base + depth);
+        handler.StartObject(size);
+        if (IsStopped(handler)) {
+          return;
+        }
+        if (0 == size) {
+          handler.EndObject(0);
+          break;
+        }
+        if (depth++ > 0) {
+          stack.Push(top);
+        }
+        top = {value->fields(), value->fields() + size, nullptr, nullptr, size};
+        break;
+      }
+      case builder::value_type::array: {
+        const size_t size = value->size();
+        stack.Enter(base + depth);
+        handler.StartArray(size, false);
+        if (IsStopped(handler)) {
+          return;
+        }
+        if (0 == size) {
+          handler.EndArray(0, false);
+          break;
+        }
+        if (depth++ > 0) {
+          stack.Push(top);
+        }
+        const builder::value_holder* begin = value->items();
+        top = {nullptr, nullptr, begin, begin + size, size};
+        break;
+      }
+      case builder::value_type::lazy_array: {
+        stack.Enter(base + depth);
+        // count is known at the end
+        handler.StartArray(0, true);
+        if (IsStopped(handler)) {
+          return;
+        }
+        size_t count = 0;
+        if constexpr (Handler::kLazyArrays) {
+          // elements are walked above all the containers of this walk and the lazy array itself
+          if (depth > 0) {
+            stack.Push(top);
+          }
+          stack.Push({});
+          ForEachArrayValue(value->as_lazy_array(), [&](const builder::value_holder& array_value) {
+            handler.ArrayValue(0 == count);
+            ++count;
+            WalkValue(handler, array_value, stack);
+            return !IsStopped(handler);
+          });
+          if (IsStopped(handler)) {
+            return;
+          }
+          stack.Pop();
+          if (depth > 0) {
+            top = stack.Pop();
+          }
+        }
+        handler.EndArray(count, true);
+        break;
+      }
+      case builder::value_type::record: {
+        const builder::record_holder& record = value->as_record();
+        const size_t size = record.type->size;
+        stack.Enter(base + depth);
+        handler.StartObject(size);
+        if (IsStopped(handler)) {
+          return;
+        }
+        // fields refer to the struct, they are walked by every handler like the object fields are
+        if (depth > 0) {
+          stack.Push(top);
+        }
+        stack.Push({});
+        for (size_t index = 0; index < size; ++index) {
+          const builder::record_field& field = record.type->fields[index];
+          if constexpr (Handler::kEscapedKeys) {
+            handler.EscapedKey(field.key, 0 == index);
+          } else {
+            handler.Key(field.name, 0 == index);
+          }
+          if (IsStopped(handler)) {
+            return;
+          }
+          VisitRecordField(record, field, [&](const builder::value_holder& field_value) {
+            if (IsContainer(field_value)) {
+              WalkValue(handler, field_value, stack);
+            } else {
+              WalkScalar(handler, field_value);
+            }
+          });
+          if (IsStopped(handler)) {
+            return;
+          }
+        }
+        stack.Pop();
+        if (depth > 0) {
+          top = stack.Pop();
+        }
+        handler.EndObject(size);
+        break;
+      }
+      case builder::value_type::lazy_object: {
+        const builder::lazy_object_holder& object = value->as_lazy_object();
+        stack.Enter(base + depth);
+        handler.StartObject(object.size);
+        if (IsStopped(handler)) {
+          return;
+        }
+        if (depth > 0) {
+          stack.Push(top);
+        }
+        stack.Push({});
+        size_t count = 0;
+        ForEachObjectField(object, [&](const std::string_view name, const builder::value_holder& field_value) {
+          RAPIDJSON_ASSERT(nullptr != name.data());
+          handler.Key(name, 0 == count);
+          ++count;
+          if (IsStopped(handler)) {
+            return false;
+          }
+          if (IsContainer(field_value)) {
+            WalkValue(handler, field_value, stack);
+          } else {
+            WalkScalar(handler, field_value);
+          }
+          return !IsStopped(handler);
+        });
+        if (IsStopped(handler)) {
+          return;
+        }
+        RAPIDJSON_ASSERT(count == object.size);
+        stack.Pop();
+        if (depth > 0) {
+          top = stack.Pop();
+        }
+        handler.EndObject(object.size);
+        break;
+      }
+      default:
+        WalkScalar(handler, *value);
+    }
+    if (IsStopped(handler)) {
+      return;
+    }
+    // go on with the innermost container until the nested one, finished containers are closed
+    value = nullptr;
+    while (depth > 0) {
+      if (nullptr != top.field) {
+        while (top.field != top.field_end) {
+          const bool first = top.size == static_cast<size_t>(top.field_end - top.field);
+          const builder::field_holder& field = *top.field++;
+          RAPIDJSON_ASSERT(nullptr != field.name.data());
+          handler.Key(field.name, first);
+          if (IsStopped(handler)) {
+            return;
+          }
+          if (IsContainer(field.value)) {
+            value = &field.value;
+            break;
+          }
+          WalkScalar(handler, field.value);
+          if (IsStopped(handler)) {
+            return;
+          }
+        }
+        if (nullptr != value) {
+          break;
+        }
+        handler.EndObject(top.size);
+      } else {
+        while (top.item != top.item_end) {
+          const bool first = top.size == static_cast<size_t>(top.item_end - top.item);
+          const builder::value_holder& item = *top.item++;
+          handler.ArrayValue(first);
+          if (IsContainer(item)) {
+            value = &item;
+            break;
+          }
+          WalkScalar(handler, item);
+          if (IsStopped(handler)) {
+            return;
+          }
+        }
+        if (nullptr != value) {
+          break;
+        }
+        handler.EndArray(top.size, false);
+      }
+      if (IsStopped(handler)) {
+        return;
+      }
+      if (--depth > 0) {
+        top = stack.Pop();
+      }
+    }
+    if (nullptr == value) {
+      return;
+    }
+  }
+}
+
+// bytes that rapidjson::Writer produces for every source byte of the string
+constexpr std::array<uint8_t, 256> kEscapedLength = [] {
+  std::array<uint8_t, 256> table{};
+  for (size_t c = 0; c < table.size(); ++c) {
+    table[c] = 1;
+  }
+  // \u00XX for control chars except the ones with short escapes
+  for (size_t c = 0; c < 0x20; ++c) {
+    table[c] = 6;
+  }
+  table['\b'] = table['\t'] = table['\n'] = table['\f'] = table['\r'] = 2;
+  table['"'] = table['\\'] = 2;
+  return table;
+}();
+
+// first char of the string that must be escaped or end, AVX2 checks 32 chars per step and SSE2 16 chars
+inline const char* FindEscape(const char* position, const char* const end) {
+#ifdef RAPID_BUILDER_AVX2
+  const __m256i quote32 = _mm256_set1_epi8('"');
+  const __m256i backslash32 = _mm256_set1_epi8('\\');
+  const __m256i control32 = _mm256_set1_epi8(0x1F);
+  for (; end - position >= 32; position += 32) {
+    const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position));
+    const __m256i special =
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chars, quote32), _mm256_cmpeq_epi8(chars, backslash32)),
+                        _mm256_cmpeq_epi8(_mm256_max_epu8(chars, control32), control32));
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+    if (0 != mask) {
+      return position + CountTrailingZeros(mask);
+    }
+  }
+#endif
+#ifdef RAPID_BUILDER_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; end - position >= 16; position += 16) {
+    const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+    // max(c, 0x1F) == 0x1F for the control chars
+    const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)),
+                                         _mm_cmpeq_epi8(_mm_max_epu8(chars, control), control));
+    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+    if (0 != mask) {
+      return position + CountTrailingZeros(mask);
+    }
+  }
+#endif
+  for (; position != end; ++position) {
+    if (1 != kEscapedLength[static_cast<unsigned char>(*position)]) {
+      return position;
+    }
+  }
+  return end;
+}
+
+// same text as rapidjson::Writer::WriteString: short clean runs and escapes are collected in the stack block, long
+// clean runs are written to the stream at once. Separators before (comma or brace) and after (colon of the key) the
+// string go to the same block, 0 for none
+template <typename Stream>
+void WriteEscaped(Stream& stream, const std::string_view value, const char before = 0, const char after = 0) {
+  static constexpr char kHexDigits[] = "0123456789ABCDEF";
+  // escape char for the control chars, u is for \u00XX
+  static constexpr char kControlEscapes[] = "uuuuuuuubtnufruuuuuuuuuuuuuuuuuu";
+  // room for the 16 byte copy of the short run, the longest escape, the closing quote and the separator
+  constexpr size_t kReserve = 16 + 8;
+  char block[512];
+  char* out = block;
+  *out = before;
+  out += 0 != before;
+  *out++ = '"';
+  const char* begin = value.data();
+  const char* const end = begin + value.size();
+  while (true) {
+    const char* special = FindEscape(begin, end);
+    const size_t run = static_cast<size_t>(special - begin);
+    if (run + kReserve > static_cast<size_t>(block + sizeof(block) - out)) {
+      WriteBlock(stream, block, static_cast<size_t>(out - block));
+      out = block;
+      if (run + kReserve > sizeof(block)) {
+        WriteBlock(stream, begin, run);
+      } else {
+        std::memcpy(out, begin, run);
+        out += run;
+      }
+#ifdef RAPID_BUILDER_SSE2
+    } else if (run < 16 && end - begin >= 16) {
+      // escapes are dense, whole 16 bytes are copied and the tail is overwritten
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)));
+      out += run;
+#endif
+    } else {
+      std::memcpy(out, begin, run);
+      out += run;
+    }
+    if (special == end) {
+      break;
+    }
+    const unsigned char c = static_cast<unsigned char>(*special);
+    out[0] = '\\';
+    out[1] = c < 0x20 ? kControlEscapes[c] : static_cast<char>(c);
+    out[2] = '0';
+    out[3] = '0';
+    out[4] = kHexDigits[c >> 4];
+    out[5] = kHexDigits[c & 0xF];
+    out += 'u' == out[1] ? 6 : 2;
+    begin = special + 1;
+  }
+  *out++ = '"';
+  *out = after;
+  out += 0 != after;
+  WriteBlock(stream, block, static_cast<size_t>(out - block));
+}
+
+template <typename Stream, typename T>
+void WriteInteger(Stream& stream, const T value) {
+  char buffer[kMaxNumberLength];
+  WriteBlock(stream, buffer, static_cast<size_t>(WriteNumber(value, float_format{}, buffer) - buffer));
+}
+
+// standard format writes nothing for nan and inf, like rapidjson::Writer does, other formats write null
+template <typename Stream, typename T>
+void WriteFloatValue(Stream& stream, const T value, const float_format& format) {
+  if (float_mode::standard == format.mode && !std::isfinite(value)) {
+    return;
+  }
+  char buffer[kMaxFloatLength];
+  WriteBlock(stream, buffer, static_cast<size_t>(WriteFloat(value, format, buffer) - buffer));
+}
+
+/**
+ * \brief walker handler that writes json text straight to the stream: separators are placed from the tree shape, text
+ * is the same as rapidjson::Writer gives for the tree
+ */
+template <typename Stream>
+class JsonTextHandler final {
+ public:
+  static constexpr bool kLazyArrays = true;
+  static constexpr bool kEscapedKeys = true;
+  static constexpr bool kStoppable = false;
+
+  JsonTextHandler(Stream& stream, const float_format& floats) noexcept : stream_(stream), floats_(floats) {}
+
+  // brace goes with the first key
+  void StartObject(const size_t size) {
+    if (0 == size) {
+      stream_.Put('{');
+    }
+  }
+  void Key(const std::string_view name, const bool first) { WriteEscaped(stream_, name, first ? '{' : ',', ':'); }
+  // quoted key with the colon
+  void EscapedKey(const std::string_view key, const bool first) {
+    stream_.Put(first ? '{' : ',');
+    WriteBlock(stream_, key.data(), key.size());
+  }
+  void EndObject(size_t) { stream_.Put('}'); }
+  void StartArray(size_t, bool) { stream_.Put('['); }
+  void ArrayValue(const bool first) {
+    if (!first) {
+      stream_.Put(',');
+    }
+  }
+  void EndArray(size_t, bool) { stream_.Put(']'); }
+
+  template <typename T>
+  void Value(const T& value) {
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      WriteBlock(stream_, "null", 4);
+    } else if constexpr (std::is_same_v<T, bool>) {
+      WriteBlock(stream_, value ? "true" : "false", value ? 4 : 5);
+    } else if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>) {
+      WriteInteger(stream_, value);
+    } else if constexpr (std::is_same_v<T, double>) {
+      WriteFloatValue(stream_, value, floats_);
+    } else if constexpr (std::is_same_v<T, builder::float_holder>) {
+      if (value.single) {
+        WriteFloatValue(stream_, static_cast<float>(value.value), value.format);
+      } else {
+        WriteFloatValue(stream_, value.value, value.format);
+      }
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      WriteEscaped(stream_, value);
+    } else if constexpr (std::is_same_v<T, builder::number_array_holder>) {
+      stream_.Put('[');
+      VisitNumbers(value, [&](const auto* values) { WriteNumbers(stream_, values, value.size, floats_); });
+      stream_.Put(']');
+    } else if constexpr (std::is_same_v<T, builder::placeholder_holder>) {
+      WritePlaceholder(stream_, value);
+    } else if constexpr (std::is_same_v<T, builder::raw_holder>) {
+      WriteBlock(stream_, value.text.data(), value.text.size());
+    } else {
+      RAPIDJSON_ASSERT(false);
+    }
+  }
+
+ private:
+  Stream& stream_;
+  const float_format& floats_;
+};
+
+// value is written straight to the stream, max_depth 0 means no limit
+template <typename Stream>
+void WriteJson(Stream& stream,
+               const builder::value_holder& value,
+               const float_format& floats = {},
+               const size_t max_depth = 0) {
+  JsonTextHandler<Stream> handler(stream, floats);
+  TraversalStack stack(max_depth);
+  WalkValue(handler, value, stack);
+}
+
+size_t MeasureDigits(uint64_t value) {
+  size_t digits = 1;
+  while (value >= 10000) {
+    value /= 10000;
+    digits += 4;
+  }
+  return digits + (value >= 10) + (value >= 100) + (value >= 1000);
+}
+
+template <typename T>
+size_t MeasureNumber(const T value, const float_format& floats) {
+  if constexpr (std::is_floating_point_v<T>) {
+    char buffer[kMaxFloatLength];
+    return static_cast<size_t>(WriteFloat(value, floats, buffer) - buffer);
+  } else if constexpr (std::is_signed_v<T>) {
+    return value < 0 ? 1 + MeasureDigits(0 - static_cast<uint64_t>(value))
+                     : MeasureDigits(static_cast<uint64_t>(value));
+  } else {
+    return MeasureDigits(static_cast<uint64_t>(value));
+  }
+}
+
+size_t MeasureString(const std::string_view value) {
+  size_t length = 2;
+  for (const char c : value) {
+    length += kEscapedLength[static_cast<unsigned char>(c)];
+  }
+  return length;
+}
+
+// same text as WriteFloatValue
+template <typename T>
+size_t MeasureFloatValue(const T value, const float_format& format) {
+  // standard format writes nothing for nan and inf
+  if (float_mode::standard == format.mode && !std::isfinite(value)) {
+    return 0;
+  }
+  return MeasureNumber(value, format);
+}
+
+/**
+ * \brief walker handler that counts json text length, same text as JsonTextHandler writes
+ */
+class MeasureHandler final {
+ public:
+  static constexpr bool kLazyArrays = true;
+  static constexpr bool kEscapedKeys = true;
+  static constexpr bool kStoppable = false;
+
+  explicit MeasureHandler(const float_format& floats) noexcept : floats_(floats) {}
+
+  // braces, commas and colons
+  void StartObject(const size_t size) { length_ += 0 == size ? 1 : 0; }
+  void Key(const std::string_view name, bool) { length_ += 1 + MeasureString(name) + 1; }
+  void EscapedKey(const std::string_view key, bool) { length_ += 1 + key.size(); }
+  void EndObject(size_t) { ++length_; }
+  void StartArray(size_t, bool) { ++length_; }
+  void ArrayValue(const bool first) { length_ += first ? 0 : 1; }
+  void EndArray(size_t, bool) { ++length_; }
+
+  template <typename T>
+  void Value(const T& value) {
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      length_ += 4;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      length_ += value ? 4 : 5;
+    } else if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>) {
+      length_ += MeasureNumber(value, floats_);
+    } else if constexpr (std::is_same_v<T, double>) {
+      length_ += MeasureFloatValue(value, floats_);
+    } else if constexpr (std::is_same_v<T, builder::float_holder>) {
+      length_ += value.single ? MeasureFloatValue(static_cast<float>(value.value), value.format)
+                              : MeasureFloatValue(value.value, value.format);
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      length_ += MeasureString(value);
+    } else if constexpr (std::is_same_v<T, builder::number_array_holder>) {
+      // brackets and commas between values
+      length_ += value.size > 0 ? value.size + 1 : 2;
+      VisitNumbers(value, [&](const auto* values) {
+        for (size_t index = 0; index < value.size; ++index) {
+          length_ += MeasureNumber(values[index], floats_);
+        }
+      });
+    } else if constexpr (std::is_same_v<T, builder::placeholder_holder>) {
+      throw std::runtime_error(kPlaceholderError);
+    } else if constexpr (std::is_same_v<T, builder::raw_holder>) {
+      length_ += value.text.size();
+    } else {
+      RAPIDJSON_ASSERT(false);
+    }
+  }
+
+  size_t Length() const noexcept { return length_; }
+
+ private:
+  const float_format& floats_;
+  size_t length_{0};
+};
+
+/**
+ * \brief walker handler that counts strings and keys with terminating zeros. Lazy arrays are skipped: their elements
+ * are enumerated once and copied one by one
+ */
+class StringsSizeHandler final {
+ public:
+  static constexpr bool kLazyArrays = false;
+  static constexpr bool kEscapedKeys = false;
+  static constexpr bool kStoppable = false;
+
+  void StartObject(size_t) {}
+  void Key(const std::string_view name, bool) { size_ += name.size() + 1; }
+  void EndObject(size_t) {}
+  void StartArray(size_t, bool) {}
+  void ArrayValue(bool) {}
+  void EndArray(size_t, bool) {}
+
+  template <typename T>
+  void Value(const T& value) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+      size_ += value.size() + 1;
+    }
+  }
+
+  size_t Size() const noexcept { return size_; }
+
+ private:
+  size_t size_{0};
+};
+
+/**
+ * \brief storage for the copied strings and keys, allocated at once from the document allocator
+ */
+class StringArena final {
+ public:
+  StringArena(rapidjson::Document::AllocatorType& allocator, const size_t size)
+      : position_(size > 0 ? static_cast<char*>(allocator.Malloc(size)) : nullptr), end_(position_ + size) {}
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+  ~StringArena() = default;
+
+  // zero terminated copy, like rapidjson makes
+  const char* Copy(const std::string_view value) {
+    RAPIDJSON_ASSERT(static_cast<size_t>(end_ - position_) > value.size());
+    char* copy = position_;
+    std::memcpy(copy, value.data(), value.size());
+    copy[value.size()] = 0;
+    position_ += value.size() + 1;
+    return copy;
+  }
+
+ private:
+  char* position_;
+  char* end_;
+};
+
+constexpr char kRawError[] = "Failed: json::raw is not a single valid json value";
+
+/**
+ * \brief rapidjson reader handler that passes the json::raw text to the SaxHandler target, small integers go as 64 bit
+ * ones like the values of the tree
+ */
+template <typename Target>
+class RawTextHandler final {
+ public:
+  explicit RawTextHandler(Target& target) noexcept : target_(target) {}
+
+  bool Null() { return target_.Null(); }
+  bool Bool(const bool value) { return target_.Bool(value); }
+  bool Int(const int value) { return target_.Int64(value); }
+  bool Uint(const unsigned value) { return target_.Uint64(value); }
+  bool Int64(const int64_t value) { return target_.Int64(value); }
+  bool Uint64(const uint64_t value) { return target_.Uint64(value); }
+  bool Double(const double value) { return target_.Double(value); }
+  // numbers are parsed, the reader calls it only with kParseNumbersAsStringsFlag
+  bool RawNumber(const char* value, const rapidjson::SizeType length, const bool copy) {
+    return target_.String(value, length, copy);
+  }
+  bool String(const char* value, const rapidjson::SizeType length, const bool copy) {
+    return target_.String(value, length, copy);
+  }
+  bool StartObject() { return target_.StartObject(); }
+  bool Key(const char* name, const rapidjson::SizeType length, const bool copy) {
+    return target_.Key(name, length, copy);
+  }
+  bool EndObject(const rapidjson::SizeType size) { return target_.EndObject(size); }
+  bool StartArray() { return target_.StartArray(); }
+  bool EndArray(const rapidjson::SizeType count) { return target_.EndArray(count); }
+
+ private:
+  Target& target_;
+};
+
+// whole text must be one value, iterative parsing keeps deep text off the native stack. False when the target stopped
+// the parsing
+template <unsigned Flags, typename Stream, typename Target>
+bool ParseRawStream(Stream& stream, const size_t size, Target& target) {
+  RawTextHandler<Target> handler(target);
+  rapidjson::Reader reader;
+  const rapidjson::ParseResult result = reader.Parse<Flags | rapidjson::kParseIterativeFlag>(stream, handler);
+  if (rapidjson::kParseErrorTermination == result.Code()) {
+    return false;
+  }
+  // zero inside of the text ends it early
+  if (result.IsError() || stream.Tell() != size) {
+    throw std::runtime_error(kRawError);
+  }
+  return true;
+}
+
+// strings of the text are passed with the copy flag
+template <typename Target>
+bool ParseRaw(Target& target, const std::string_view text) {
+  rapidjson::MemoryStream stream(text.data(), text.size());
+  return ParseRawStream<rapidjson::kParseDefaultFlags>(stream, text.size(), target);
+}
+
+// text is copied to the document allocator and parsed in situ, strings of the document reference the copy
+bool ParseRaw(rapidjson::Document& document, const std::string_view text) {
+  char* copy = static_cast<char*>(document.GetAllocator().Malloc(text.size() + 1));
+  std::memcpy(copy, text.data(), text.size());
+  copy[text.size()] = 0;
+  rapidjson::InsituStringStream stream(copy);
+  return ParseRawStream<rapidjson::kParseInsituFlag>(stream, text.size(), document);
+}
+
+/**
+ * \brief walker handler that passes values to the rapidjson SAX handler. Document collects container elements on its
+ * stack and moves them to the container allocated once with the exact size. Strings of the lazy array elements are
+ * passed with the copy flag: elements can be temporaries that die right after the element is built. All other strings
+ * are copied to the arena if it is set. json::raw text is parsed right in the value place. Handler that returns false
+ * stops the walk
+ */
+template <typename Target>
+class SaxHandler final {
+ public:
+  static constexpr bool kLazyArrays = true;
+  static constexpr bool kEscapedKeys = false;
+  static constexpr bool kStoppable = true;
+
+  SaxHandler(Target& target, StringArena* arena) noexcept : target_(target), arena_(arena) {}
+
+  void StartObject(size_t) { Check(target_.StartObject()); }
+  void Key(const std::string_view name, bool) { PutString(name, true); }
+  void EndObject(const size_t size) { Check(target_.EndObject(static_cast<rapidjson::SizeType>(size))); }
+  void StartArray(size_t, const bool lazy) {
+    Check(target_.StartArray());
+    lazy_depth_ += lazy ? 1 : 0;
+  }
+  void ArrayValue(bool) {}
+  void EndArray(const size_t count, const bool lazy) {
+    Check(target_.EndArray(static_cast<rapidjson::SizeType>(count)));
+    lazy_depth_ -= lazy ? 1 : 0;
+  }
+
+  bool Stopped() const noexcept { return stopped_; }
+
+  template <typename T>
+  void Value(const T& value) {
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      Check(target_.Null());
+    } else if constexpr (std::is_same_v<T, bool>) {
+      Check(target_.Bool(value));
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+      Check(target_.Int64(value));
+    } else if constexpr (std::is_same_v<T, uint64_t>) {
+      Check(target_.Uint64(value));
+    } else if constexpr (std::is_same_v<T, double>) {
+      Check(target_.Double(value));
+    } else if constexpr (std::is_same_v<T, builder::float_holder>) {
+      // format is for the json text only, null is the same as in json string
+      if (std::isfinite(value.value)) {
+        Check(target_.Double(value.value));
+      } else {
+        Check(target_.Null());
+      }
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      PutString(value, false);
+    } else if constexpr (std::is_same_v<T, builder::number_array_holder>) {
+      Check(target_.StartArray());
+      VisitNumbers(value, [&](const auto* values) {
+        using V = std::remove_cv_t<std::remove_pointer_t<decltype(values)>>;
+        for (size_t index = 0; index < value.size && !stopped_; ++index) {
+          if constexpr (std::is_floating_point_v<V>) {
+            // same as in json string
+            if (std::isfinite(values[index])) {
+              Check(target_.Double(static_cast<double>(values[index])));
+            } else {
+              Check(target_.Null());
+            }
+          } else if constexpr (std::is_signed_v<V>) {
+            Check(target_.Int64(static_cast<int64_t>(values[index])));
+          } else {
+            Check(target_.Uint64(static_cast<uint64_t>(values[index])));
+          }
+        }
+      });
+      if (!stopped_) {
+        Check(target_.EndArray(static_cast<rapidjson::SizeType>(value.size)));
+      }
+    } else if constexpr (std::is_same_v<T, builder::placeholder_holder>) {
+      throw std::runtime_error(kPlaceholderError);
+    } else if constexpr (std::is_same_v<T, builder::raw_holder>) {
+      Check(ParseRaw(target_, value.text));
+    } else {
+      RAPIDJSON_ASSERT(false);
+    }
+  }
+
+ private:
+  void PutString(const std::string_view string, const bool key) {
+    const bool copy = lazy_depth_ > 0;
+    const char* data = string.data();
+    if (nullptr != arena_ && !copy) {
+      data = arena_->Copy(string);
+    }
+    if (key) {
+      Check(target_.Key(data, static_cast<rapidjson::SizeType>(string.size()), copy));
+    } else {
+      Check(target_.String(data, static_cast<rapidjson::SizeType>(string.size()), copy));
+    }
+  }
+
+  void Check(const bool result) noexcept { stopped_ = stopped_ || !result; }
+
+  Target& target_;
+  StringArena* arena_;
+  // lazy arrays the walker is inside of
+  size_t lazy_depth_{0};
+  // target returned false
+  bool stopped_{false};
+};
+
+// initial SAX stack of the documents we create, stack grows by reallocation and is freed after every build, so it is
+// allocated once for the usual json sizes
+constexpr size_t kDocumentStackCapacity = 16 * 1024;
+
+// stateless, documents we create use it instead of allocating own one
+rapidjson::CrtAllocator document_stack_allocator;
+
+// fills the document through its SAX handler
+void PopulateDocument(rapidjson::Document& document,
+                      const builder::value_holder& value,
+                      const document_options& options) {
+  auto generator = [&](rapidjson::Document& handler) {
+    TraversalStack stack(options.max_depth);
+    if (options.copy_strings) {
+      StringsSizeHandler strings;
+      WalkValue(strings, value, stack);
+      StringArena arena(handler.GetAllocator(), strings.Size());
+      SaxHandler<rapidjson::Document> document_handler(handler, &arena);
+      WalkValue(document_handler, value, stack);
+    } else {
+      SaxHandler<rapidjson::Document> document_handler(handler, nullptr);
+      WalkValue(document_handler, value, stack);
+    }
+    return true;
+  };
+  document.Populate(generator);
+}
+
+/**
+ * \brief output of the binary formats, bytes are appended to the string. Containers with the count known at the end
+ * (lazy arrays, containers of json::raw text) reserve the longest header and the shortest one is put in its place
+ */
+class BinaryOutput final {
+ public:
+  explicit BinaryOutput(std::string& output) noexcept : output_(output) {}
+
+  void Put(const uint8_t byte) { output_.push_back(static_cast<char>(byte)); }
+  // marker and the value in big endian order, both formats use it for multibyte numbers
+  template <typename T>
+  void PutBigEndian(const uint8_t marker, const T value) {
+    char bytes[1 + sizeof(T)];
+    bytes[0] = static_cast<char>(marker);
+    for (size_t index = 0; index < sizeof(T); ++index) {
+      bytes[sizeof(T) - index] = static_cast<char>(static_cast<uint64_t>(value) >> (8 * index));
+    }
+    output_.append(bytes, sizeof(bytes));
+  }
+  void Append(const std::string_view bytes) { output_.append(bytes.data(), bytes.size()); }
+
+  void Open(const size_t reserved) {
+    open_.push_back(output_.size());
+    output_.append(reserved, '\0');
+  }
+  // header writes into the output it is given
+  template <typename Header>
+  void Close(const size_t reserved, Header&& header) {
+    const size_t offset = open_.back();
+    open_.pop_back();
+    std::string bytes;
+    BinaryOutput header_output(bytes);
+    header(header_output);
+    char* const data = &output_[offset];
+    std::memmove(data + bytes.size(), data + reserved, output_.size() - offset - reserved);
+    std::memcpy(data, bytes.data(), bytes.size());
+    output_.resize(output_.size() - (reserved - bytes.size()));
+  }
+
+ private:
+  std::string& output_;
+  // offsets of the reserved headers
+  std::vector<size_t> open_;
+};
+
+template <typename T, typename F>
+T BitCast(const F value) noexcept {
+  static_assert(sizeof(T) == sizeof(F), "same size types");
+  T result;
+  std::memcpy(&result, &value, sizeof(T));
+  return result;
+}
+
+/**
+ * \brief MessagePack: positive and negative fixint, fixstr, fixarray and fixmap for small values, then the 8, 16, 32
+ * and 64 bit forms. Doubles stay float 64 and floats float 32, so the decoded types are the same
+ */
+struct MsgpackFormat final {
+  static constexpr size_t kMaxHeader = 5;
+
+  static void Null(BinaryOutput& output) { output.Put(0xc0); }
+  static void Bool(BinaryOutput& output, const bool value) { output.Put(value ? 0xc3 : 0xc2); }
+  static void Uint64(BinaryOutput& output, const uint64_t value) {
+    if (value < 0x80) {
+      output.Put(static_cast<uint8_t>(value));
+    } else if (value <= UINT8_MAX) {
+      output.PutBigEndian(0xcc, static_cast<uint8_t>(value));
+    } else if (value <= UINT16_MAX) {
+      output.PutBigEndian(0xcd, static_cast<uint16_t>(value));
+    } else if (value <= UINT32_MAX) {
+      output.PutBigEndian(0xce, static_cast<uint32_t>(value));
+    } else {
+      output.PutBigEndian(0xcf, value);
+    }
+  }
+  // non negative values take the unsigned forms
+  static void Int64(BinaryOutput& output, const int64_t value) {
+    if (value >= 0) {
+      Uint64(output, static_cast<uint64_t>(value));
+    } else if (value >= -32) {
+      output.Put(static_cast<uint8_t>(value));
+    } else if (value >= INT8_MIN) {
+      output.PutBigEndian(0xd0, static_cast<int8_t>(value));
+    } else if (value >= INT16_MIN) {
+      output.PutBigEndian(0xd1, static_cast<int16_t>(value));
+    } else if (value >= INT32_MIN) {
+      output.PutBigEndian(0xd2, static_cast<int32_t>(value));
+    } else {
+      output.PutBigEndian(0xd3, value);
+    }
+  }
+  static void Float(BinaryOutput& output, const float value) { output.PutBigEndian(0xca, BitCast<uint32_t>(value)); }
+  static void Double(BinaryOutput& output, const double value) { output.PutBigEndian(0xcb, BitCast<uint64_t>(value)); }
+  static void String(BinaryOutput& output, const std::string_view value) {
+    const size_t size = CheckLength(value.size());
+    if (size < 32) {
+      output.Put(static_cast<uint8_t>(0xa0 | size));
+    } else if (size <= UINT8_MAX) {
+      output.PutBigEndian(0xd9, static_cast<uint8_t>(size));
+    } else if (size <= UINT16_MAX) {
+      output.PutBigEndian(0xda, static_cast<uint16_t>(size));
+    } else {
+      output.PutBigEndian(0xdb, static_cast<uint32_t>(size));
+    }
+    output.Append(value);
+  }
+  static void Array(BinaryOutput& output, const size_t size) { Container(output, 0x90, 0xdc, size); }
+  static void Map(BinaryOutput& output, const size_t size) { Container(output, 0x80, 0xde, size); }
+
+ private:
+  static size_t CheckLength(const size_t size) {
+    if (size > UINT32_MAX) {
+      throw std::runtime_error("Failed: MessagePack lengths are limited by 32 bits");
+    }
+    return size;
+  }
+  // fix form and the 16 bit one, the 32 bit one follows it
+  static void Container(BinaryOutput& output, const uint8_t fix, const uint8_t marker, const size_t size) {
+    CheckLength(size);
+    if (size < 16) {
+      output.Put(static_cast<uint8_t>(fix | size));
+    } else if (size <= UINT16_MAX) {
+      output.PutBigEndian(marker, static_cast<uint16_t>(size));
+    } else {
+      output.PutBigEndian(static_cast<uint8_t>(marker + 1), static_cast<uint32_t>(size));
+    }
+  }
+};
+
+/**
+ * \brief CBOR (RFC 8949): the argument of the head is inline below 24, then takes 1, 2, 4 or 8 bytes. Doubles that
+ * float keeps exactly go as float 32
+ */
+struct CborFormat final {
+  static constexpr size_t kMaxHeader = 9;
+
+  static void Null(BinaryOutput& output) { output.Put(0xf6); }
+  static void Bool(BinaryOutput& output, const bool value) { output.Put(value ? 0xf5 : 0xf4); }
+  static void Uint64(BinaryOutput& output, const uint64_t value) { Head(output, 0, value); }
+  // negative integer n is written as -1 - n
+  static void Int64(BinaryOutput& output, const int64_t value) {
+    if (value >= 0) {
+      Head(output, 0, static_cast<uint64_t>(value));
+    } else {
+      Head(output, 1, static_cast<uint64_t>(-(value + 1)));
+    }
+  }
+  static void Float(BinaryOutput& output, const float value) { output.PutBigEndian(0xfa, BitCast<uint32_t>(value)); }
+  static void Double(BinaryOutput& output, const double value) {
+    const float single = static_cast<float>(value);
+    if (static_cast<double>(single) == value) {
+      Float(output, single);
+    } else {
+      output.PutBigEndian(0xfb, BitCast<uint64_t>(value));
+    }
+  }
+  static void String(BinaryOutput& output, const std::string_view value) {
+    Head(output, 3, value.size());
+    output.Append(value);
+  }
+  static void Array(BinaryOutput& output, const size_t size) { Head(output, 4, size); }
+  static void Map(BinaryOutput& output, const size_t size) { Head(output, 5, size); }
+
+ private:
+  static void Head(BinaryOutput& output, const uint8_t major, const uint64_t value) {
+    const uint8_t type = static_cast<uint8_t>(major << 5);
+    if (value < 24) {
+      output.Put(static_cast<uint8_t>(type | value));
+    } else if (value <= UINT8_MAX) {
+      output.PutBigEndian(type | 24, static_cast<uint8_t>(value));
+    } else if (value <= UINT16_MAX) {
+      output.PutBigEndian(type | 25, static_cast<uint16_t>(value));
+    } else if (value <= UINT32_MAX) {
+      output.PutBigEndian(type | 26, static_cast<uint32_t>(value));
+    } else {
+      output.PutBigEndian(type | 27, value);
+    }
+  }
+};
+
+/**
+ * \brief rapidjson SAX target that writes json::raw text in the binary format, containers are closed when the
+ * reader gives their counts
+ */
+template <typename Format>
+class RawBinaryHandler final {
+ public:
+  explicit RawBinaryHandler(BinaryOutput& output) noexcept : output_(output) {}
+
+  bool Null() {
+    Format::Null(output_);
+    return true;
+  }
+  bool Bool(const bool value) {
+    Format::Bool(output_, value);
+    return true;
+  }
+  bool Int64(const int64_t value) {
+    Format::Int64(output_, value);
+    return true;
+  }
+  bool Uint64(const uint64_t value) {
+    Format::Uint64(output_, value);
+    return true;
+  }
+  bool Double(const double value) {
+    Format::Double(output_, value);
+    return true;
+  }
+  bool String(const char* value, const rapidjson::SizeType length, bool) {
+    Format::String(output_, std::string_view(value, length));
+    return true;
+  }
+  bool StartObject() {
+    output_.Open(Format::kMaxHeader);
+    return true;
+  }
+  bool Key(const char* name, const rapidjson::SizeType length, bool) {
+    Format::String(output_, std::string_view(name, length));
+    return true;
+  }
+  bool EndObject(const rapidjson::SizeType size) {
+    output_.Close(Format::kMaxHeader, [&](BinaryOutput& header) { Format::Map(header, size); });
+    return true;
+  }
+  bool StartArray() {
+    output_.Open(Format::kMaxHeader);
+    return true;
+  }
+  bool EndArray(const rapidjson::SizeType count) {
+    output_.Close(Format::kMaxHeader, [&](BinaryOutput& header) { Format::Array(header, count); });
+    return true;
+  }
+
+ private:
+  BinaryOutput& output_;
+};
+
+/**
+ * \brief walker handler that writes the value in the binary format: objects and arrays get the count in the header,
+ * formats of the floats are for json text only, non finite values are kept
+ */
+template <typename Format>
+class BinaryHandler final {
+ public:
+  static constexpr bool kLazyArrays = true;
+  static constexpr bool kEscapedKeys = false;
+  static constexpr bool kStoppable = false;
+
+  explicit BinaryHandler(BinaryOutput& output) noexcept : output_(output) {}
+
+  void StartObject(const size_t size) { Format::Map(output_, size); }
+  void Key(const std::string_view name, bool) { Format::String(output_, name); }
+  void EndObject(size_t) {}
+  void StartArray(const size_t size, const bool lazy) {
+    if (lazy) {
+      output_.Open(Format::kMaxHeader);
+    } else {
+      Format::Array(output_, size);
+    }
+  }
+  void ArrayValue(bool) {}
+  void EndArray(const size_t count, const bool lazy) {
+    if (lazy) {
+      output_.Close(Format::kMaxHeader, [&](BinaryOutput& header) { Format::Array(header, count); });
+    }
+  }
+
+  template <typename T>
+  void Value(const T& value) {
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      Format::Null(output_);
+    } else if constexpr (std::is_same_v<T, bool>) {
+      Format::Bool(output_, value);
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+      Format::Int64(output_, value);
+    } else if constexpr (std::is_same_v<T, uint64_t>) {
+      Format::Uint64(output_, value);
+    } else if constexpr (std::is_same_v<T, double>) {
+      Format::Double(output_, value);
+    } else if constexpr (std::is_same_v<T, builder::float_holder>) {
+      if (value.single) {
+        Format::Float(output_, static_cast<float>(value.value));
+      } else {
+        Format::Double(output_, value.value);
+      }
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      Format::String(output_, value);
+    } else if constexpr (std::is_same_v<T, builder::number_array_holder>) {
+      Format::Array(output_, value.size);
+      VisitNumbers(value, [&](const auto* values) {
+        using V = std::remove_cv_t<std::remove_pointer_t<decltype(values)>>;
+        for (size_t index = 0; index < value.size; ++index) {
+          if constexpr (std::is_same_v<V, float>) {
+            Format::Float(output_, values[index]);
+          } else if constexpr (std::is_floating_point_v<V>) {
+            Format::Double(output_, values[index]);
+          } else if constexpr (std::is_signed_v<V>) {
+            Format::Int64(output_, static_cast<int64_t>(values[index]));
+          } else {
+            Format::Uint64(output_, static_cast<uint64_t>(values[index]));
+          }
+        }
+      });
+    } else if constexpr (std::is_same_v<T, builder::placeholder_holder>) {
+      throw std::runtime_error(kPlaceholderError);
+    } else if constexpr (std::is_same_v<T, builder::raw_holder>) {
+      RawBinaryHandler<Format> raw(output_);
+      ParseRaw(raw, value.text);
+    } else {
+      RAPIDJSON_ASSERT(false);
+    }
+  }
+
+ private:
+  BinaryOutput& output_;
+};
+
+// previous content of the output is replaced
+template <typename Format>
+void WriteBinary(std::string& output, const builder::value_holder& value, const size_t max_depth) {
+  output.clear();
+  BinaryOutput stream(output);
+  BinaryHandler<Format> handler(stream);
+  TraversalStack stack(max_depth);
+  WalkValue(handler, value, stack);
+}
+
+// marks the context busy for the build
+class BusyGuard final {
+ public:
+  explicit BusyGuard(bool& busy) : busy_(busy) {
+    RAPIDJSON_ASSERT(!busy_);
+    busy_ = true;
+  }
+  BusyGuard(const BusyGuard&) = delete;
+  BusyGuard& operator=(const BusyGuard&) = delete;
+  ~BusyGuard() { busy_ = false; }
+
+ private:
+  bool& busy_;
+};
+
+/**
+ * \brief shared workers for the parallel build, threads are started on the first use and kept until exit. The calling
+ * thread takes part in every job, so nested jobs finish even when all workers are busy
+ */
+class WorkerPool final {
+ public:
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  static WorkerPool& Instance() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  // task(index) for every index below count on the calling thread and at most threads - 1 workers, returns when all
+  // of them are done. Workers are kept for the next runs, there are no more of them than the hardware threads. Task
+  // must not throw
+  void Run(const size_t count, const size_t threads, const std::function<void(size_t)>& task) {
+    if (0 == count) {
+      return;
+    }
+    auto job = std::make_shared<Job>(task, count);
+    static const size_t max_helpers = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    const size_t helpers = std::min(std::min(threads, count) - 1, max_helpers);
+    if (helpers > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (threads_.size() < helpers) {
+        threads_.emplace_back([this] { Work(); });
+      }
+      for (size_t index = 0; index < helpers; ++index) {
+        jobs_.push_back(job);
+      }
+    }
+    wake_.notify_all();
+    job->Execute();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&job] { return job->finished.load() == job->count; });
+  }
+
+ private:
+  struct Job final {
+    Job(const std::function<void(size_t)>& job_task, const size_t job_count) : task(job_task), count(job_count) {}
+
+    // claims indexes until all are taken, late helpers find nothing and never touch the task
+    void Execute() {
+      for (size_t index = next++; index < count; index = next++) {
+        task(index);
+        if (finished.fetch_add(1) + 1 == count) {
+          std::lock_guard<std::mutex> lock(mutex);
+          done.notify_all();
+        }
+      }
+    }
+
+    const std::function<void(size_t)>& task;
+    const size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> finished{0};
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+
+  void Work() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (stop_) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      job->Execute();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+  std::vector<std::thread> threads_;
+  bool stop_{false};
+};
+
+// chunks per thread of the parallel array, smaller chunks even out the uneven items
+constexpr size_t kChunksPerThread = 4;
+// levels of the containers that are searched for the large arrays, deeper ones are written by the serial walk
+constexpr size_t kParallelSearchDepth = 4;
+
+/**
+ * \brief walker handler that looks for the lazy arrays, their elements are not enumerated and the walk stops at the
+ * first one
+ */
+class LazyArraysHandler final {
+ public:
+  static constexpr bool kLazyArrays = false;
+  static constexpr bool kEscapedKeys = false;
+  static constexpr bool kStoppable = true;
+
+  void StartObject(size_t) {}
+  void Key(std::string_view, bool) {}
+  void EndObject(size_t) {}
+  void StartArray(size_t, const bool lazy) { found_ = found_ || lazy; }
+  void ArrayValue(bool) {}
+  void EndArray(size_t, bool) {}
+
+  template <typename T>
+  void Value(const T&) {}
+
+  bool Found() const noexcept { return found_; }
+  // first lazy array is enough
+  bool Stopped() const noexcept { return found_; }
+
+ private:
+  bool found_{false};
+};
+
+// items of the large array are split in chunks, every chunk is written into own buffer on the worker and the buffers
+// are written in order. Chunks after the first one start with the comma, so the text is the same as the serial one.
+// Chunks with the lazy arrays are left to the calling thread: generators and projections are user code that may keep
+// own state
+template <typename Stream>
+void WriteChunks(Stream& stream, const builder::value_holder& array, const size_t depth, const build_options& options) {
+  const size_t size = array.size();
+  const builder::value_holder* items = array.items();
+  const size_t chunks = std::min(size, options.parallel_threads * kChunksPerThread);
+  std::vector<std::string> texts(chunks);
+  std::vector<std::exception_ptr> errors(chunks);
+  // char, not bool: workers set own elements
+  std::vector<char> serial(chunks, 0);
+  const auto write_chunk = [&](const size_t chunk) {
+    StringOutputStream chunk_stream(texts[chunk]);
+    JsonTextHandler<StringOutputStream> handler(chunk_stream, options.floats);
+    // items are nested into depth containers
+    TraversalStack stack(options.max_depth);
+    for (size_t level = 0; level < depth; ++level) {
+      stack.Push({});
+    }
+    const size_t end = size * (chunk + 1) / chunks;
+    for (size_t index = size * chunk / chunks; index < end; ++index) {
+      handler.ArrayValue(0 == index);
+      WalkValue(handler, items[index], stack);
     }
+  };
+  WorkerPool::Instance().Run(chunks, options.parallel_threads, [&](const size_t chunk) {
+    try {
+      LazyArraysHandler lazy_arrays;
+      TraversalStack stack(0);
+      const size_t end = size * (chunk + 1) / chunks;
+      for (size_t index = size * chunk / chunks; index < end && !lazy_arrays.Found(); ++index) {
+        WalkValue(lazy_arrays, items[index], stack);
+      }
+      if (lazy_arrays.Found()) {
+        serial[chunk] = 1;
+        return;
+      }
+      write_chunk(chunk);
+    } catch (...) {
+      errors[chunk] = std::current_exception();
+    }
+  });
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (0 != serial[chunk] && !errors[chunk]) {
+      try {
+        write_chunk(chunk);
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+    }
+  }
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  for (const auto& text : texts) {
+    WriteBlock(stream, text.data(), text.size());
+  }
+}
+
+// top containers are written here, large arrays in them go to the workers and the rest goes to the serial walk
+template <typename Stream>
+void WriteParallelValue(Stream& stream,
+                        JsonTextHandler<Stream>& handler,
+                        const builder::value_holder& value,
+                        TraversalStack& stack,
+                        const size_t level,
+                        const build_options& options) {
+  const builder::value_type type = value.type();
+  const size_t size = value.size();
+  if (builder::value_type::array == type && size >= std::max(options.parallel_threshold, static_cast<size_t>(1))) {
+    stack.Enter(stack.Size());
+    handler.StartArray(size, false);
+    WriteChunks(stream, value, stack.Size() + 1, options);
+    handler.EndArray(size, false);
+    return;
+  }
+  if (level >= kParallelSearchDepth || 0 == size ||
+      (builder::value_type::object != type && builder::value_type::array != type)) {
+    WalkValue(handler, value, stack);
+    return;
+  }
+  stack.Enter(stack.Size());
+  stack.Push({});
+  if (builder::value_type::object == type) {
+    handler.StartObject(size);
+    for (size_t index = 0; index < size; ++index) {
+      const builder::field_holder& field = value.fields()[index];
+      RAPIDJSON_ASSERT(nullptr != field.name.data());
+      handler.Key(field.name, 0 == index);
+      WriteParallelValue(stream, handler, field.value, stack, level + 1, options);
+    }
+    handler.EndObject(size);
   } else {
-    for (const auto& array_value : holder.list_items) {
-      func(array_value);
-    }
-  }
-}
-
-void RecursiveJsonBuilder(rapidjson::Writer<rapidjson::StringBuffer>& writer, const builder::value_holder& value) {
-  std::visit(
-      [&](auto&& arg) {
-        using T = std::decay_t<decltype(arg)>;
-        if constexpr (std::is_same_v<T, std::nullptr_t>) {
-          writer.Null();
-        } else if constexpr (std::is_same_v<T, bool>) {
-          writer.Bool(arg);
-        } else if constexpr (std::is_same_v<T, int64_t>) {
-          writer.Int64(arg);
-        } else if constexpr (std::is_same_v<T, uint64_t>) {
-          writer.Uint64(arg);
-        } else if constexpr (std::is_same_v<T, double>) {
-          writer.Double(arg);
-        } else if constexpr (std::is_same_v<T, std::string_view>) {
-          writer.String(arg.data(), static_cast<rapidjson::SizeType>(arg.size()));
-        } else if constexpr (std::is_same_v<T, std::initializer_list<builder::field_holder>>) {
-          // start writing object recursively
-          writer.StartObject();
-          for (const builder::field_holder& field : arg) {
-            RAPIDJSON_ASSERT(nullptr != field.name.data());
-            writer.Key(field.name.data(), static_cast<rapidjson::SizeType>(field.name.size()), false);
-            RecursiveJsonBuilder(writer, field.value);
-          }
-          writer.EndObject();
-          // end writing object recursively
-        } else if constexpr (std::is_same_v<T, builder::array_holder>) {
-          // start writing array recursively
-          writer.StartArray();
-          ForEachArrayValue(arg, [&](const builder::value_holder& array_value) {
-            RecursiveJsonBuilder(writer, array_value);
-          });
-          writer.EndArray();
-          // end writing array recursively
-        } else {
-          RAPIDJSON_ASSERT(false);
-        }
-      },
-      value.holder);
-}
-
-// recursive function
-void RecursiveValueBuilder(rapidjson::Value& result,
-                           rapidjson::Document::AllocatorType& allocator,
-                           const builder::value_holder& value) {
-  std::visit(
-      [&](auto&& arg) {
-        using T = std::decay_t<decltype(arg)>;
-        if constexpr (std::is_same_v<T, std::nullptr_t>) {
-          result.SetNull();
-        } else if constexpr (std::is_same_v<T, bool>) {
-          result.SetBool(arg);
-        } else if constexpr (std::is_same_v<T, int64_t>) {
-          result.SetInt64(arg);
-        } else if constexpr (std::is_same_v<T, uint64_t>) {
-          result.SetUint64(arg);
-        } else if constexpr (std::is_same_v<T, double>) {
-          result.SetDouble(arg);
-        } else if constexpr (std::is_same_v<T, std::string_view>) {
-          result.SetString(arg.data(), static_cast<rapidjson::SizeType>(arg.size()));
-        } else if constexpr (std::is_same_v<T, std::initializer_list<builder::field_holder>>) {
-          // start writing object recursively
-          result.SetObject();
-          for (const builder::field_holder& field : arg) {
-            RAPIDJSON_ASSERT(nullptr != field.name.data());
-            // create rapid json value from details::value
-            rapidjson::Value member_value;
-            RecursiveValueBuilder(member_value, allocator, field.value);
-            result.AddMember(
-                rapidjson::StringRef(field.name.data(), field.name.size()), std::move(member_value), allocator);
-          }
-          // end writing object recursively
-        } else if constexpr (std::is_same_v<T, builder::array_holder>) {
-          // start writing array recursively
-          result.SetArray();
-          ForEachArrayValue(arg, [&](const builder::value_holder& array_value) {
-            rapidjson::Value member_value;
-            RecursiveValueBuilder(member_value, allocator, array_value);
-            result.PushBack(std::move(member_value), allocator);
-          });
-          // end writing array recursively
-        } else {
-          RAPIDJSON_ASSERT(false);
+    handler.StartArray(size, false);
+    for (size_t index = 0; index < size; ++index) {
+      handler.ArrayValue(0 == index);
+      WriteParallelValue(stream, handler, value.items()[index], stack, level + 1, options);
+    }
+    handler.EndArray(size, false);
+  }
+  stack.Pop();
+}
+
+// json text with the large arrays written by parallel_threads threads
+template <typename Stream>
+void WriteJsonParallel(Stream& stream, const builder::value_holder& value, const build_options& options) {
+  JsonTextHandler<Stream> handler(stream, options.floats);
+  TraversalStack stack(options.max_depth);
+  WriteParallelValue(stream, handler, value, stack, 0, options);
+}
+
+// serial or parallel build of the json text
+template <typename Stream>
+void WriteJsonWithOptions(Stream& stream, const builder::value_holder& value, const build_options& options) {
+  if (options.parallel_threads > 1) {
+    WriteJsonParallel(stream, value, options);
+  } else {
+    WriteJson(stream, value, options.floats, options.max_depth);
+  }
+}
+
+// static text runs with the slot values between them, slot(index) gives the end of the text run before the slot and
+// the slot value
+template <typename Slot>
+void WriteTemplate(std::string& output, const std::string_view text, const size_t slots, Slot&& slot) {
+  output.clear();
+  StringOutputStream stream(output);
+  size_t begin = 0;
+  for (size_t index = 0; index < slots; ++index) {
+    const std::pair<size_t, const builder::value_holder&> current = slot(index);
+    stream.Write(text.data() + begin, current.first - begin);
+    begin = current.first;
+    WriteJson(stream, current.second);
+  }
+  stream.Write(text.data() + begin, text.size() - begin);
+}
+
+// appends json to the string
+void AppendJson(std::string& output, const builder::value_holder& value, const build_options& options) {
+  if (options.exact_size) {
+    MeasuredStringOutputStream stream(output, measure(value, options.floats));
+    WriteJsonWithOptions(stream, value, options);
+  } else {
+    StringOutputStream stream(output);
+    WriteJsonWithOptions(stream, value, options);
+  }
+}
+
+// messages per chunk of the batch, workers take the chunks one by one
+constexpr size_t kBatchChunk = 64;
+
+// chunk buffers of the batches built by the thread, kept warm between the batches
+struct BatchBuffers final {
+  std::vector<std::string> chunks;
+  bool busy{false};
+};
+
+// messages of the batch are written by chunks into the reused buffers, every message ends with the separator (0 for
+// none). ends gets the end of every message in the chunk buffer, output gets the chunks in order. Chunks with the lazy
+// arrays are written on the calling thread, the same as the parallel array chunks
+void BuildBatch(std::string& output,
+                size_t* ends,
+                const builder::value_holder* values,
+                const size_t count,
+                const build_options& options,
+                size_t threads,
+                const char separator) {
+  if (0 == threads) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  thread_local BatchBuffers thread_buffers;
+  // nested batch from the lazy array generator takes own buffers
+  BatchBuffers local_buffers;
+  BatchBuffers& buffers = thread_buffers.busy ? local_buffers : thread_buffers;
+  BusyGuard guard(buffers.busy);
+  const size_t chunks = (count + kBatchChunk - 1) / kBatchChunk;
+  if (buffers.chunks.size() < chunks) {
+    buffers.chunks.resize(chunks);
+  }
+  std::vector<std::exception_ptr> errors(chunks);
+  // char, not bool: workers set own elements
+  std::vector<char> serial(chunks, 0);
+  const auto write_chunk = [&](const size_t chunk) {
+    std::string& text = buffers.chunks[chunk];
+    text.clear();
+    const size_t end = std::min(count, (chunk + 1) * kBatchChunk);
+    for (size_t index = chunk * kBatchChunk; index < end; ++index) {
+      AppendJson(text, values[index], options);
+      if (0 != separator) {
+        text.push_back(separator);
+      }
+      if (nullptr != ends) {
+        ends[index] = text.size();
+      }
+    }
+  };
+  WorkerPool::Instance().Run(chunks, threads, [&](const size_t chunk) {
+    try {
+      LazyArraysHandler lazy_arrays;
+      TraversalStack stack(0);
+      const size_t end = std::min(count, (chunk + 1) * kBatchChunk);
+      for (size_t index = chunk * kBatchChunk; index < end && !lazy_arrays.Found(); ++index) {
+        WalkValue(lazy_arrays, values[index], stack);
+      }
+      if (lazy_arrays.Found()) {
+        serial[chunk] = 1;
+        return;
+      }
+      write_chunk(chunk);
+    } catch (...) {
+      errors[chunk] = std::current_exception();
+    }
+  });
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (0 != serial[chunk] && !errors[chunk]) {
+      try {
+        write_chunk(chunk);
+      } catch (...) {
+        errors[chunk] = std::current_exception();
+      }
+    }
+  }
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  size_t size = output.size();
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    size += buffers.chunks[chunk].size();
+  }
+  output.reserve(size);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    std::string& text = buffers.chunks[chunk];
+    if (nullptr != ends) {
+      const size_t end = std::min(count, (chunk + 1) * kBatchChunk);
+      for (size_t index = chunk * kBatchChunk; index < end; ++index) {
+        ends[index] += output.size();
+      }
+    }
+    output.append(text);
+    // same memory limit as the thread build_context has
+    if (text.capacity() > build_context::thread_capacity) {
+      std::string().swap(text);
+    }
+  }
+}
+
+// sinks of the streaming build and lines_writer, every chunk is written at once
+
+sink_function StreamSink(std::ostream& stream) {
+  return [&stream](std::string_view chunk) {
+    if (!stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()))) {
+      throw std::runtime_error("Failed: can't write json to stream");
+    }
+  };
+}
+
+sink_function FileSink(std::FILE* file) {
+  RAPIDJSON_ASSERT(nullptr != file);
+  return [file](std::string_view chunk) {
+    if (std::fwrite(chunk.data(), 1, chunk.size(), file) != chunk.size()) {
+      throw std::runtime_error("Failed: can't write json to file");
+    }
+  };
+}
+
+sink_function DescriptorSink(const int fd) {
+  return [fd](std::string_view chunk) {
+    while (!chunk.empty()) {
+#ifdef _WIN32
+      const auto written = _write(fd, chunk.data(), static_cast<unsigned int>(chunk.size()));
+#else
+      const auto written = write(fd, chunk.data(), chunk.size());
+#endif
+      if (written < 0) {
+        if (EINTR == errno) {
+          continue;
         }
-      },
-      value.holder);
+        throw std::runtime_error(std::string("Failed: can't write json to fd: ") + std::strerror(errno));
+      }
+      chunk.remove_prefix(static_cast<size_t>(written));
+    }
+  };
 }
 
 }  // namespace
 
+/**
+ * \brief pass the value to the SAX handler
+ */
+bool emit(const builder::value_holder& value, builder::sax_target& target, const size_t max_depth) {
+  SaxHandler<builder::sax_target> handler(target, nullptr);
+  TraversalStack stack(max_depth);
+  WalkValue(handler, value, stack);
+  return !handler.Stopped();
+}
+
 std::string stringify(const rapidjson::Document& document) {
-  rapidjson::StringBuffer buffer;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  std::string result;
+  stringify_into(result, document);
+  return result;
+}
+
+void stringify_into(std::string& output, const rapidjson::Document& document) {
+  output.clear();
+  StringOutputStream stream(output);
+  rapidjson::Writer<StringOutputStream> writer(stream);
   document.Accept(writer);
-  return std::string(buffer.GetString(), buffer.GetSize());
 }
 
 builder::array_holder array(std::initializer_list<builder::value_holder> list) {
   return builder::array_holder(list);
 }
 
+struct build_context::state final {
+  std::string buffer;
+  size_t size_hint{0};
+  bool busy{false};
+};
+
+build_context::build_context() : state_(std::make_unique<state>()) {}
+
+build_context::~build_context() = default;
+
+/**
+ * \brief build json into the context buffer
+ */
+std::string_view build_context::build(const builder::value_holder& value, const build_options& options) {
+  BusyGuard guard(state_->busy);
+  state_->buffer.clear();
+  AppendJson(state_->buffer, value, options);
+  state_->size_hint = state_->buffer.size();
+  return state_->buffer;
+}
+
+/**
+ * \brief build json into the caller owned string
+ */
+void build_context::build_into(std::string& output,
+                               const builder::value_holder& value,
+                               const build_options& options) {
+  output.clear();
+  AppendJson(output, value, options);
+  state_->size_hint = output.size();
+}
+
+/**
+ * \brief build json and append it to the caller owned string
+ */
+void build_context::build_append(std::string& output,
+                                 const builder::value_holder& value,
+                                 const build_options& options) {
+  const size_t start = output.size();
+  AppendJson(output, value, options);
+  state_->size_hint = output.size() - start;
+}
+
+bool build_context::busy() const noexcept {
+  return state_->busy;
+}
+
+size_t build_context::size_hint() const noexcept {
+  return state_->size_hint;
+}
+
+void build_context::trim(const size_t max_capacity) noexcept {
+  if (state_->buffer.capacity() > max_capacity) {
+    std::string().swap(state_->buffer);
+  }
+}
+
+build_context& build_context::for_thread() {
+  thread_local build_context context;
+  return context;
+}
+
 /**
  * \brief build json string
  */
-std::string build(const builder::value_holder& value) {
-  rapidjson::StringBuffer string_buffer;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(string_buffer);
+std::string build(const builder::value_holder& value, const build_options& options) {
+  std::string result;
+  if (options.thread_context && !options.exact_size) {
+    // json is written straight into the result, the size of the previous build on this thread saves the regrowth
+    build_context& context = build_context::for_thread();
+    result.reserve(std::min(context.size_hint(), build_context::thread_capacity));
+    context.build_append(result, value, options);
+    return result;
+  }
+  build_append(result, value, options);
+  return result;
+}
+
+/**
+ * \brief build json string into the caller owned string
+ */
+void build_into(std::string& output, const builder::value_holder& value, const build_options& options) {
+  output.clear();
+  build_append(output, value, options);
+}
+
+/**
+ * \brief build json string and append it to the caller owned string
+ */
+void build_append(std::string& output, const builder::value_holder& value, const build_options& options) {
+  AppendJson(output, value, options);
+}
+
+/**
+ * \brief exact size of the json string
+ */
+size_t measure(const builder::value_holder& value, const float_format& floats) {
+  MeasureHandler handler(floats);
+  TraversalStack stack(0);
+  WalkValue(handler, value, stack);
+  return handler.Length();
+}
+
+/**
+ * \brief build json string into the reusable rapidjson buffer
+ */
+std::string_view build(rapidjson::StringBuffer& buffer, const builder::value_holder& value) {
+  buffer.Clear();
+  // recursive builder
+  WriteJson(buffer, value);
+  return std::string_view(buffer.GetString(), buffer.GetSize());
+}
+
+struct fragment_cache::state final {
+  struct entry final {
+    entry(const std::string_view entry_key, const uint64_t entry_version, std::shared_ptr<const std::string> entry_text)
+        : key(entry_key), version(entry_version), text(std::move(entry_text)) {}
+
+    size_t bytes() const noexcept { return key.size() + text->size(); }
+
+    const std::string key;
+    const uint64_t version;
+    const std::shared_ptr<const std::string> text;
+    // hit since the last eviction pass, set under the shared lock
+    std::atomic<bool> used{false};
+  };
+  using entries_list = std::list<entry>;
+
+  explicit state(const size_t budget) noexcept : max_bytes(budget) {}
+
+  std::shared_ptr<const std::string> Find(const std::string_view key, const uint64_t version) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const auto it = index.find(key);
+    if (index.end() == it || it->second->version != version) {
+      return nullptr;
+    }
+    it->second->used.store(true, std::memory_order_relaxed);
+    return it->second->text;
+  }
+
+  void Store(const std::string_view key, const uint64_t version, std::shared_ptr<const std::string> text) {
+    const size_t size = key.size() + text->size();
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    const auto it = index.find(key);
+    if (index.end() != it) {
+      Erase(it->second);
+    }
+    // text larger than the cache is used once
+    if (size > max_bytes) {
+      return;
+    }
+    while (bytes + size > max_bytes) {
+      EvictOne();
+    }
+    entries.emplace_front(key, version, std::move(text));
+    // index keys reference the keys of the list nodes
+    index.emplace(entries.front().key, entries.begin());
+    bytes += size;
+  }
+
+  void Clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    index.clear();
+    entries.clear();
+    bytes = 0;
+  }
+
+  // oldest entry that was not hit goes, hit ones are moved to the front with the flag cleared
+  void EvictOne() {
+    while (true) {
+      const auto last = std::prev(entries.end());
+      if (!last->used.exchange(false, std::memory_order_relaxed)) {
+        Erase(last);
+        return;
+      }
+      entries.splice(entries.begin(), entries, last);
+    }
+  }
+
+  void Erase(const entries_list::iterator it) {
+    bytes -= it->bytes();
+    index.erase(it->key);
+    entries.erase(it);
+  }
+
+  mutable std::shared_mutex mutex;
+  // newest first
+  entries_list entries;
+  std::unordered_map<std::string_view, entries_list::iterator> index;
+  const size_t max_bytes;
+  size_t bytes{0};
+  std::atomic<size_t> hits{0};
+  std::atomic<size_t> misses{0};
+};
+
+fragment_cache::fragment_cache(const size_t max_bytes) : state_(std::make_unique<state>(max_bytes)) {}
+
+fragment_cache::~fragment_cache() = default;
+
+size_t fragment_cache::hits() const noexcept {
+  return state_->hits.load(std::memory_order_relaxed);
+}
+
+size_t fragment_cache::misses() const noexcept {
+  return state_->misses.load(std::memory_order_relaxed);
+}
+
+size_t fragment_cache::size() const {
+  std::shared_lock<std::shared_mutex> lock(state_->mutex);
+  return state_->entries.size();
+}
+
+size_t fragment_cache::bytes() const {
+  std::shared_lock<std::shared_mutex> lock(state_->mutex);
+  return state_->bytes;
+}
+
+void fragment_cache::clear() {
+  state_->Clear();
+}
+
+/**
+ * \brief cached text of the subtree or the new one, built without the lock: concurrent misses of the same key build
+ * it each and the last one stays
+ */
+builder::cached_holder cached(fragment_cache& cache,
+                              const std::string_view key,
+                              const uint64_t version,
+                              const builder::value_holder& value,
+                              const build_options& options) {
+  fragment_cache::state& state = *cache.state_;
+  if (auto text = state.Find(key, version)) {
+    state.hits.fetch_add(1, std::memory_order_relaxed);
+    return builder::cached_holder(std::move(text));
+  }
+  state.misses.fetch_add(1, std::memory_order_relaxed);
+  auto text = std::make_shared<std::string>();
+  build_into(*text, value, options);
+  std::shared_ptr<const std::string> result(std::move(text));
+  state.Store(key, version, result);
+  return builder::cached_holder(std::move(result));
+}
+
+/**
+ * \brief MessagePack encoding of the value
+ */
+std::string build_msgpack(const builder::value_holder& value, const size_t max_depth) {
+  std::string result;
+  build_msgpack_into(result, value, max_depth);
+  return result;
+}
+
+void build_msgpack_into(std::string& output, const builder::value_holder& value, const size_t max_depth) {
+  WriteBinary<MsgpackFormat>(output, value, max_depth);
+}
+
+/**
+ * \brief CBOR encoding of the value
+ */
+std::string build_cbor(const builder::value_holder& value, const size_t max_depth) {
+  std::string result;
+  build_cbor_into(result, value, max_depth);
+  return result;
+}
+
+void build_cbor_into(std::string& output, const builder::value_holder& value, const size_t max_depth) {
+  WriteBinary<CborFormat>(output, value, max_depth);
+}
+
+/**
+ * \brief build json strings of the independent values into the batch
+ */
+void build_many_into(build_batch& batch,
+                     const builder::value_holder* values,
+                     const size_t count,
+                     const build_options& options,
+                     const size_t threads) {
+  batch.text.clear();
+  batch.offsets.assign(count + 1, 0);
+  BuildBatch(batch.text, batch.offsets.data() + 1, values, count, options, threads, 0);
+}
+
+/**
+ * \brief build json strings of the independent values in one buffer
+ */
+build_batch build_many(const builder::value_holder* values,
+                       const size_t count,
+                       const build_options& options,
+                       const size_t threads) {
+  build_batch batch;
+  build_many_into(batch, values, count, options, threads);
+  return batch;
+}
+
+/**
+ * \brief build newline delimited json of the independent values
+ */
+void build_many_lines(std::string& output,
+                      const builder::value_holder* values,
+                      const size_t count,
+                      const build_options& options,
+                      const size_t threads) {
+  BuildBatch(output, nullptr, values, count, options, threads, '\n');
+}
+
+/**
+ * \brief build json and stream it to the sink in chunks
+ */
+void build_to(const sink_function& sink, const builder::value_holder& value, const size_t chunk_size) {
+  ChunkOutputStream stream(sink, chunk_size);
   // recursive builder
-  RecursiveJsonBuilder(writer, value);
-  // get the json string and return it
-  return std::string(string_buffer.GetString(), string_buffer.GetSize());
+  WriteJson(stream, value);
+  // pass the tail to the sink
+  stream.Flush();
+}
+
+/**
+ * \brief build json and stream it to std::ostream in chunks
+ */
+void build_to(std::ostream& stream, const builder::value_holder& value, const size_t chunk_size) {
+  build_to(StreamSink(stream), value, chunk_size);
+}
+
+/**
+ * \brief build json and stream it to FILE* in chunks
+ */
+void build_to(std::FILE* file, const builder::value_holder& value, const size_t chunk_size) {
+  build_to(FileSink(file), value, chunk_size);
+}
+
+/**
+ * \brief build json and stream it to the file descriptor in chunks
+ */
+void build_to(const int fd, const builder::value_holder& value, const size_t chunk_size) {
+  build_to(DescriptorSink(fd), value, chunk_size);
+}
+
+lines_writer::lines_writer(sink_function sink, const lines_options& options)
+    : sink_(std::move(sink)), options_(options) {
+  buffer_.reserve(options_.flush_bytes);
+}
+
+lines_writer::lines_writer(std::ostream& stream, const lines_options& options)
+    : lines_writer(StreamSink(stream), options) {}
+
+lines_writer::lines_writer(std::FILE* file, const lines_options& options) : lines_writer(FileSink(file), options) {}
+
+lines_writer::lines_writer(const int fd, const lines_options& options) : lines_writer(DescriptorSink(fd), options) {}
+
+lines_writer::~lines_writer() {
+  try {
+    flush();
+  } catch (...) {
+    // destructor can't report the sink error, flush() explicitly to get it
+  }
+}
+
+/**
+ * \brief append the record to the buffer and flush it if a limit is reached
+ */
+void lines_writer::write(const builder::value_holder& record) {
+  const size_t size = buffer_.size();
+  try {
+    build_append(buffer_, record, options_.build);
+  } catch (...) {
+    // failed record leaves nothing in the buffer
+    buffer_.resize(size);
+    throw;
+  }
+  buffer_.push_back('\n');
+  ++records_;
+  if (buffer_.size() >= options_.flush_bytes || (0 != options_.flush_records && records_ >= options_.flush_records)) {
+    flush();
+  }
+}
+
+/**
+ * \brief pass the buffered records to the sink with one call
+ */
+void lines_writer::flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  sink_(buffer_);
+  buffer_.clear();
+  records_ = 0;
+}
+
+namespace detail {
+/**
+ * \brief static fragments of the compiled shape with slot values between them
+ */
+void build_shape_into(std::string& output,
+                      const std::string_view text,
+                      const size_t* ends,
+                      std::initializer_list<builder::value_holder> values) {
+  WriteTemplate(output, text, values.size(), [&](const size_t index) {
+    return std::pair<size_t, const builder::value_holder&>(ends[index], values.begin()[index]);
+  });
+}
+}  // namespace detail
+
+/**
+ * \brief prepare the template from the value with placeholders
+ */
+prepared prepare(const builder::value_holder& value) {
+  prepared result;
+  std::vector<std::pair<size_t, builder::placeholder_holder>> placeholders;
+  {
+    TemplateOutputStream stream(result.text_);
+    WriteJson(stream, value);
+    placeholders = stream.TakePlaceholders();
+  }
+  result.slots_.reserve(placeholders.size());
+  for (const auto& [text_end, placeholder] : placeholders) {
+    const bool named = nullptr != placeholder.name.data();
+    if (!result.slots_.empty() && named != result.named_) {
+      throw std::runtime_error("Failed: json::prepare placeholders must be all positional or all named");
+    }
+    result.named_ = named;
+    size_t argument = placeholder.index;
+    if (named) {
+      // named placeholders are numbered in the order of appearance
+      const auto it = std::find(result.names_.begin(), result.names_.end(), placeholder.name);
+      argument = static_cast<size_t>(it - result.names_.begin());
+      if (result.names_.end() == it) {
+        result.names_.emplace_back(placeholder.name);
+      }
+    } else {
+      result.arguments_ = std::max(result.arguments_, argument + 1);
+    }
+    result.slots_.push_back({text_end, argument});
+  }
+  return result;
+}
+
+/**
+ * \brief build json string from the prepared template, values by position
+ */
+void prepared::build_positional_into(std::string& output, std::initializer_list<builder::value_holder> values) const {
+  if (values.size() != arguments()) {
+    throw std::runtime_error("Failed: json::prepared expects " + std::to_string(arguments()) + " values");
+  }
+  WriteTemplate(output, text_, slots_.size(), [&](const size_t index) {
+    const slot& current = slots_[index];
+    return std::pair<size_t, const builder::value_holder&>(current.text_end, values.begin()[current.argument]);
+  });
+}
+
+/**
+ * \brief build json string from the prepared template, values by name
+ */
+std::string prepared::build_named(std::initializer_list<builder::field_holder> values) const {
+  std::string output;
+  build_named_into(output, values);
+  return output;
+}
+
+/**
+ * \brief build json string from the prepared template into the caller owned string, values by name
+ */
+void prepared::build_named_into(std::string& output, std::initializer_list<builder::field_holder> values) const {
+  if (!named_ && !slots_.empty()) {
+    throw std::runtime_error("Failed: json::prepared has positional placeholders");
+  }
+  WriteTemplate(output, text_, slots_.size(), [&](const size_t index) {
+    const slot& current = slots_[index];
+    const std::string& name = names_[current.argument];
+    // templates are small, linear search is faster than any map here
+    const auto it = std::find_if(values.begin(), values.end(), [&](const builder::field_holder& field) {
+      return field.name == name;
+    });
+    if (values.end() == it) {
+      throw std::runtime_error("Failed: no value for json::placeholder(\"" + name + "\")");
+    }
+    return std::pair<size_t, const builder::value_holder&>(current.text_end, it->value);
+  });
 }
 
 /**
  * \brief build rapidjson value (array or object)
  */
-rapidjson::Value build_value(const builder::value_holder& value, rapidjson::Document::AllocatorType& allocator) {
+rapidjson::Value build_value(const builder::value_holder& value,
+                             rapidjson::Document::AllocatorType& allocator,
+                             const document_options& options) {
+  // temporary document only lends its SAX handler, values are allocated with the allocator
+  rapidjson::Document document(&allocator, kDocumentStackCapacity, &document_stack_allocator);
+  PopulateDocument(document, value, options);
   rapidjson::Value result;
-  // recursive builder
-  RecursiveValueBuilder(result, allocator, value);
+  // rapidjson assignment moves
+  result = static_cast<rapidjson::Value&>(document);
   return result;
 }
 
 /**
  * \brief build rapidjson document with array or object
  */
-rapidjson::Document build_document(const builder::value_holder& value) {
-  rapidjson::Document result;
-  RecursiveValueBuilder(result, result.GetAllocator(), value);
+rapidjson::Document build_document(const builder::value_holder& value, const document_options& options) {
+  rapidjson::Document result(nullptr, kDocumentStackCapacity, &document_stack_allocator);
+  PopulateDocument(result, value, options);
   return result;
 }
 
+/**
+ * \brief build array or object into the existing document
+ */
+void build_document(rapidjson::Document& document,
+                    const builder::value_holder& value,
+                    const document_options& options) {
+  document.SetNull();
+  document.GetAllocator().Clear();
+  PopulateDocument(document, value, options);
+}
+
 }  // namespace json
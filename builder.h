@@ -45,43 +45,176 @@
 // rapidjson errors handling
 
 #include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <new>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <utility>
-#include <variant>
 #include <vector>
 
 namespace json {
+
+/**
+ * \brief formatting mode of the floating point values
+ */
+enum class float_mode {
+  // rapidjson Grisu2 output, whole values get ".0": 1.0, 0.1, 1e30
+  standard,
+  // shortest text that parses back to the same value (Ryu, std::to_chars): 1, 0.1, 1e+30. Floats are written as floats
+  shortest,
+  // precision digits after the decimal point: 1.00, 0.10
+  fixed,
+  // at most precision significant digits, trailing zeros are dropped: 1, 0.1, 1.23457e+06
+  significant
+};
+
+/**
+ * \brief floating point formatting, non finite values are written as null by all modes except the standard one
+ */
+struct float_format final {
+  // largest precision of the fixed and significant modes
+  static constexpr int max_precision = 30;
+
+  float_mode mode{float_mode::standard};
+  // digits after the decimal point for the fixed mode, significant digits (1 or more) for the significant mode
+  int precision{0};
+};
+
 namespace builder {
 
 struct value_holder;
+struct array_holder;
+
+// copies of the items in new memory
+value_holder* copy_items(const value_holder* items, size_t size);
+// destroys the items and frees their memory
+void free_items(value_holder* items, size_t size) noexcept;
 
 /**
- * @brief array source type
+ * \brief type erased source of the lazy array, elements are pulled from it during traversal and never stored
  */
-enum class array_source { vector_t, list_t };
+struct lazy_array_holder {
+  // receives every element of the lazy array, false ends the enumeration: the walk is stopped
+  using visitor = bool (*)(void* context, const value_holder& value);
+  // passes every element of the source to the visitor
+  using enumerator = void (*)(const lazy_array_holder& source, visitor visit, void* context);
+
+  enumerator for_each;
+};
 
 /**
- * \brief internal array structure to trick value_holder constructor
+ * \brief type erased source of the object fields, fields are pulled from it during traversal and never stored
  */
-struct array_holder final {
-  array_holder() = default;
-  array_holder(size_t reserve) { items.reserve(reserve); };
-  array_holder(std::initializer_list<value_holder> values) noexcept
-      : list_items(values), source(array_source::list_t) {};
-  array_holder(const array_holder& src) = default;
-  array_holder(array_holder&& src) = default;
-  ~array_holder() = default;
+struct lazy_object_holder {
+  // receives every field of the lazy object, false ends the enumeration: the walk is stopped
+  using visitor = bool (*)(void* context, std::string_view name, const value_holder& value);
+  // passes every field of the source to the visitor
+  using enumerator = void (*)(const lazy_object_holder& source, visitor visit, void* context);
 
-  // items source for array
-  array_source source{array_source::vector_t};
-  // actual values for container source
-  std::vector<value_holder> items;
-  // actual values for the initializer_list source give us a 25% performance gain for arrays that passed as
-  // initializer_list.
-  std::initializer_list<value_holder> list_items;
+  enumerator for_each;
+  // count of the fields the source passes, objects are sized before the first field
+  size_t size;
+};
+
+/**
+ * \brief field of the struct described with json::describe: name, key text escaped at compile time and the value
+ */
+struct record_field final {
+  std::string_view name;
+  // "name": with quotes and colon
+  std::string_view key;
+  // passes the field value of the object to the visitor
+  void (*visit)(const void* object, lazy_array_holder::visitor visit, void* context);
+};
+
+/**
+ * \brief fields of the described struct, one static table per type
+ */
+struct record_type final {
+  const record_field* fields;
+  size_t size;
+};
+
+/**
+ * \brief object of the described struct, fields are read while building
+ */
+struct record_holder final {
+  const void* object;
+  const record_type* type;
+};
+
+/**
+ * \brief element type of the numeric array
+ */
+enum class number_type { int8, int16, int32, int64, uint8, uint16, uint32, uint64, float32, float64 };
+
+/**
+ * \brief numeric array over the contiguous memory, formatted in batches without per element dispatch
+ */
+struct number_array_holder final {
+  const void* data;
+  size_t size;
+  number_type type;
+};
+
+/**
+ * \brief numeric array element type for the C++ type, integers are mapped by size and signedness
+ */
+template <typename T>
+constexpr number_type number_type_of() noexcept {
+  static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, long double>,
+                "numeric array accepts integers, float and double");
+  if constexpr (std::is_floating_point_v<T>) {
+    return std::is_same_v<T, float> ? number_type::float32 : number_type::float64;
+  } else if constexpr (std::is_signed_v<T>) {
+    return sizeof(T) == 1   ? number_type::int8
+           : sizeof(T) == 2 ? number_type::int16
+           : sizeof(T) == 4 ? number_type::int32
+                            : number_type::int64;
+  } else {
+    return sizeof(T) == 1   ? number_type::uint8
+           : sizeof(T) == 2 ? number_type::uint16
+           : sizeof(T) == 4 ? number_type::uint32
+                            : number_type::uint64;
+  }
+}
+
+/**
+ * \brief floating point value with own formatting
+ */
+struct float_holder final {
+  double value;
+  float_format format;
+  // value is float, shortest text is the shortest one for float
+  bool single;
+};
+
+/**
+ * \brief slot of the prepared template, filled by argument position or by name
+ */
+struct placeholder_holder final {
+  // name of the named placeholder, null for positional one
+  std::string_view name;
+  // argument position of the positional placeholder
+  size_t index;
+};
+
+/**
+ * \brief json text that goes to the output as is
+ */
+struct raw_holder final {
+  std::string_view text;
 };
 
 /**
@@ -106,23 +239,46 @@ struct field_holder final {
 };
 
 /**
- * \brief generic json value holder
+ * \brief type of the value in value_holder
+ */
+enum class value_type : uint8_t {
+  null,
+  string,
+  int64,
+  uint64,
+  float64,
+  boolean,
+  object,
+  array,
+  lazy_array,
+  number_array,
+  formatted_float,
+  placeholder,
+  raw,
+  record,
+  lazy_object
+};
+
+/**
+ * \brief generic json value holder: 8 bytes of the value and 8 bytes of the size and type. Strings, objects, arrays
+ * and numeric arrays reference their data, only arrays built from containers own their items
  */
-struct value_holder final {
+struct value_holder {
   // bool
-  constexpr value_holder(const bool value) noexcept : holder(value) {}
+  constexpr value_holder(const bool value) noexcept : value_holder(value_type::boolean, payload_type(value)) {}
 
   // const nullptr_t
-  constexpr value_holder(const nullptr_t value) noexcept : holder(value) {}
+  constexpr value_holder(const nullptr_t) noexcept : value_holder(value_type::null, payload_type()) {}
 
   // const char*
-  constexpr value_holder(const char* value) noexcept : holder(value) {}
+  constexpr value_holder(const char* value) noexcept : value_holder(std::string_view(value)) {}
   // const std::string& value
-  value_holder(const std::string& value) noexcept : holder(value) {}
+  value_holder(const std::string& value) noexcept : value_holder(std::string_view(value)) {}
   // std::string_view value
-  constexpr value_holder(std::string_view value) noexcept : holder(std::move(value)) {}
+  constexpr value_holder(std::string_view value) noexcept
+      : value_holder(value_type::string, payload_type(value.data()), value.size()) {}
   // int64_t
-  constexpr value_holder(const int64_t value) noexcept : holder(value) {}
+  constexpr value_holder(const int64_t value) noexcept : value_holder(value_type::int64, payload_type(value)) {}
 #ifdef __linux__
   // long long
   constexpr value_holder(const long long value) noexcept : value_holder(static_cast<int64_t>(value)) {}
@@ -137,7 +293,7 @@ struct value_holder final {
   // char as 8 bit signed value
   constexpr value_holder(const char value) noexcept : value_holder(static_cast<int64_t>(value)) {}
   // uint64_t
-  constexpr value_holder(const uint64_t value) noexcept : holder(value) {}
+  constexpr value_holder(const uint64_t value) noexcept : value_holder(value_type::uint64, payload_type(value)) {}
 #ifdef __linux__
   // unsigned long long
   constexpr value_holder(const unsigned long long value) noexcept : value_holder(static_cast<uint64_t>(value)) {}
@@ -152,36 +308,485 @@ struct value_holder final {
   // unsigned char as 8 bit unsigned value
   constexpr value_holder(const unsigned char value) noexcept : value_holder(static_cast<uint64_t>(value)) {}
   // double
-  constexpr value_holder(const double value) noexcept : holder(value) {}
+  constexpr value_holder(const double value) noexcept : value_holder(value_type::float64, payload_type(value)) {}
   // float
   constexpr value_holder(const float value) noexcept : value_holder(static_cast<double>(value)) {}
 
   // object from initializer_list
-  value_holder(std::initializer_list<field_holder> value) noexcept : holder(value) {}
+  value_holder(std::initializer_list<field_holder> value) noexcept
+      : value_holder(value_type::object, payload_type(value.begin()), value.size()) {}
+
+  // array from initializer_list or container, braced lists of values come here. Inline items of the container are
+  // moved to the heap, so it can throw std::bad_alloc
+  value_holder(array_holder&& value);
+
+  // lazy array from range or generator, source must outlive the build call
+  value_holder(const lazy_array_holder& value) noexcept : value_holder(value_type::lazy_array, payload_type(&value)) {}
+
+  // numeric array from contiguous memory, memory must outlive the build call
+  value_holder(const number_array_holder& value) noexcept
+      : value_holder(value_type::number_array,
+                     payload_type(value.data),
+                     value.size,
+                     static_cast<uint8_t>(value.type)) {}
+
+  // floating point value with own formatting: mode and single flag go to the extra bits, precision to the size bits
+  value_holder(const float_holder& value) noexcept
+      : value_holder(value_type::formatted_float,
+                     payload_type(value.value),
+                     static_cast<uint32_t>(value.format.precision),
+                     static_cast<uint8_t>(static_cast<uint8_t>(value.format.mode) << 1 | (value.single ? 1 : 0))) {}
+
+  // slot of the prepared template, valid only in json::prepare
+  value_holder(const placeholder_holder& value) noexcept
+      : value_holder(value_type::placeholder,
+                     nullptr != value.name.data() ? payload_type(value.name.data()) : payload_type(value.index),
+                     value.name.size(),
+                     nullptr != value.name.data() ? kNamedPlaceholder : 0) {}
+
+  // json text, text must outlive the build call
+  constexpr value_holder(const raw_holder& value) noexcept
+      : value_holder(value_type::raw, payload_type(value.text.data()), value.text.size()) {}
+
+  // object of the described struct, struct must outlive the build call
+  value_holder(const record_holder& value) noexcept
+      : value_holder(value_type::record, payload_type(static_cast<const void*>(&value))) {}
+
+  // object from map or other container of key value pairs, source must outlive the build call
+  value_holder(const lazy_object_holder& value) noexcept
+      : value_holder(value_type::lazy_object, payload_type(static_cast<const void*>(&value))) {}
+
+  // copy constructor, owned items and items of the array_holder are copied
+  value_holder(const value_holder& src);
+  // move constructor, owned items are taken over without allocation, so containers of values grow by moves. Inline
+  // items of the array_holder moved by the base reference go to the heap, allocation failure terminates there
+  value_holder(value_holder&& src) noexcept;
+  value_holder& operator=(const value_holder&) = delete;
+  value_holder& operator=(value_holder&&) = delete;
+  ~value_holder() {
+    if (owns_items()) {
+      free_items(const_cast<value_holder*>(payload_.items), size());
+    }
+  }
+
+  value_type type() const noexcept { return static_cast<value_type>(type_); }
+  // length of the string, number of the object fields, array items or numbers
+  size_t size() const noexcept { return static_cast<size_t>(size_); }
+
+  bool as_bool() const noexcept { return payload_.boolean; }
+  int64_t as_int64() const noexcept { return payload_.int64; }
+  uint64_t as_uint64() const noexcept { return payload_.uint64; }
+  double as_double() const noexcept { return payload_.float64; }
+  std::string_view as_string() const noexcept { return {payload_.chars, size()}; }
+  const field_holder* fields() const noexcept { return payload_.fields; }
+  const value_holder* items() const noexcept { return payload_.items; }
+  const lazy_array_holder& as_lazy_array() const noexcept { return *payload_.lazy; }
+  number_array_holder as_numbers() const noexcept {
+    return {payload_.data, size(), static_cast<number_type>(extra_)};
+  }
+  float_holder as_float() const noexcept {
+    return {payload_.float64,
+            {static_cast<float_mode>(extra_ >> 1), static_cast<int>(static_cast<uint32_t>(size_))},
+            0 != (extra_ & 1)};
+  }
+  placeholder_holder as_placeholder() const noexcept {
+    if (kNamedPlaceholder == extra_) {
+      return {as_string(), 0};
+    }
+    return {std::string_view(), static_cast<size_t>(payload_.uint64)};
+  }
+  raw_holder as_raw() const noexcept { return {as_string()}; }
+  const record_holder& as_record() const noexcept { return *static_cast<const record_holder*>(payload_.data); }
+  const lazy_object_holder& as_lazy_object() const noexcept {
+    return *static_cast<const lazy_object_holder*>(payload_.data);
+  }
+
+ private:
+  friend struct array_holder;
+
+  // extra bits of the array that owns its items memory
+  static constexpr uint8_t kOwnedItems = 1;
+  // extra bits of the array_holder base, items are in the array_holder
+  static constexpr uint8_t kHolderItems = 2;
+  // extra bits of the named placeholder
+  static constexpr uint8_t kNamedPlaceholder = 1;
+
+  union payload_type {
+    constexpr payload_type() noexcept : uint64(0) {}
+    constexpr explicit payload_type(const bool value) noexcept : boolean(value) {}
+    constexpr explicit payload_type(const int64_t value) noexcept : int64(value) {}
+    constexpr explicit payload_type(const uint64_t value) noexcept : uint64(value) {}
+    constexpr explicit payload_type(const double value) noexcept : float64(value) {}
+    constexpr explicit payload_type(const char* value) noexcept : chars(value) {}
+    constexpr explicit payload_type(const field_holder* value) noexcept : fields(value) {}
+    constexpr explicit payload_type(const value_holder* value) noexcept : items(value) {}
+    constexpr explicit payload_type(const lazy_array_holder* value) noexcept : lazy(value) {}
+    constexpr explicit payload_type(const void* value) noexcept : data(value) {}
+
+    bool boolean;
+    int64_t int64;
+    uint64_t uint64;
+    double float64;
+    const char* chars;
+    const field_holder* fields;
+    const value_holder* items;
+    const lazy_array_holder* lazy;
+    const void* data;
+  };
+
+  constexpr value_holder(const value_type type,
+                         const payload_type payload,
+                         const size_t size = 0,
+                         const uint8_t extra = 0) noexcept
+      : payload_(payload), size_(size), extra_(extra), type_(static_cast<uint64_t>(type)) {}
+
+  bool owns_items() const noexcept { return value_type::array == type() && kOwnedItems == extra_; }
+  bool holder_items() const noexcept { return value_type::array == type() && kHolderItems == extra_; }
+  // items of the moved value become owned by this one
+  void take_items(value_holder& src);
+
+  payload_type payload_;
+  // sizes are limited by 48 bits, more than any address space in use has
+  uint64_t size_ : 48;
+  // number_type of the numeric array, float format of the formatted value, owned items and named placeholder flags
+  uint64_t extra_ : 8;
+  uint64_t type_ : 8;
+};
+
+static_assert(sizeof(value_holder) <= 16, "value_holder must stay compact, large payloads go out of line");
+static_assert(std::is_nothrow_move_constructible_v<value_holder>, "vectors of values must grow by moves");
+
+/**
+ * \brief growable storage of the array items with the small inline buffer, like the small vector. Short containers
+ * are kept without heap allocation, longer ones spill to the heap memory that value_holder can take over
+ */
+class items_buffer final {
+ public:
+  // items kept inline, tags, coordinates and pairs fit
+  static constexpr size_t inline_capacity = 4;
+
+  items_buffer() noexcept = default;
+  items_buffer(const items_buffer& src);
+  items_buffer(items_buffer&& src) noexcept;
+  items_buffer& operator=(const items_buffer&) = delete;
+  items_buffer& operator=(items_buffer&&) = delete;
+  ~items_buffer() { clear(); }
+
+  void reserve(size_t capacity);
+  template <typename... ARGS>
+  value_holder& emplace_back(ARGS&&... args);
+  void push_back(const value_holder& value);
+  void push_back(value_holder&& value);
+  // destroys the items and frees the heap memory
+  void clear() noexcept;
+
+  size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return 0 == size_; }
+  const value_holder* data() const noexcept { return items_; }
+  const value_holder* begin() const noexcept { return items_; }
+  const value_holder* end() const noexcept { return items_ + size_; }
+
+  // heap memory with size() items goes to the caller and the buffer is empty, inline items are moved to the new
+  // memory. Items are freed with free_items(), empty buffer gives nullptr
+  value_holder* release();
+
+ private:
+  value_holder* inline_items() noexcept { return reinterpret_cast<value_holder*>(inline_); }
+  bool is_inline() const noexcept { return items_ == reinterpret_cast<const value_holder*>(inline_); }
+  void grow();
+
+  value_holder* items_{inline_items()};
+  size_t size_{0};
+  size_t capacity_{inline_capacity};
+  alignas(value_holder) unsigned char inline_[inline_capacity * sizeof(value_holder)];
+};
+
+/**
+ * \brief array from initializer_list or container, it's the value_holder itself, so the array passed to the object
+ * field or to the build call is used in place and its inline items are never copied. initializer_list items are
+ * referenced like before and give us a 25% performance gain for arrays that passed as initializer_list.
+ */
+struct array_holder final : value_holder {
+  array_holder() noexcept : value_holder(value_type::array, payload_type()) {}
+  array_holder(size_t reserve) : array_holder() { items.reserve(reserve); }
+  array_holder(std::initializer_list<value_holder> values) noexcept
+      : value_holder(value_type::array, payload_type(values.begin()), values.size()) {}
+  array_holder(const array_holder& src)
+      : value_holder(value_type::array, src.payload_, src.size(), src.extra_), items(src.items) {
+    sync();
+  }
+  array_holder(array_holder&& src) noexcept
+      : value_holder(value_type::array, src.payload_, src.size(), src.extra_), items(std::move(src.items)) {
+    sync();
+    src.sync();
+  }
+  ~array_holder() = default;
+
+  void reserve(const size_t capacity) {
+    items.reserve(capacity);
+    // items may move to the new memory
+    sync();
+  }
+  template <typename... ARGS>
+  value_holder& emplace_back(ARGS&&... args) {
+    value_holder& value = items.emplace_back(std::forward<ARGS>(args)...);
+    sync();
+    return value;
+  }
+  void push_back(const value_holder& value) { emplace_back(value); }
+  void push_back(value_holder&& value) { emplace_back(std::move(value)); }
+
+ private:
+  friend struct value_holder;
+
+  // base points to the container items, initializer_list arrays have no items and keep the list
+  void sync() noexcept {
+    if (!items.empty() || holder_items()) {
+      payload_.items = items.data();
+      size_ = items.size();
+      extra_ = items.empty() ? 0 : kHolderItems;
+    }
+  }
+
+  // actual values for container source
+  items_buffer items;
+};
+
+/**
+ * \brief json text of the cached subtree, the text is kept alive while the holder lives. Copies of the base reference
+ * the text like strings do
+ */
+struct cached_holder final : value_holder {
+  explicit cached_holder(std::shared_ptr<const std::string> text) noexcept
+      : value_holder(raw_holder{*text}), text_(std::move(text)) {}
+
+ private:
+  std::shared_ptr<const std::string> text_;
+};
+
+inline value_holder::value_holder(const value_holder& src)
+    : payload_(src.payload_), size_(src.size_), extra_(src.extra_), type_(src.type_) {
+  if (src.owns_items() || src.holder_items()) {
+    payload_.items = copy_items(src.payload_.items, src.size());
+    extra_ = kOwnedItems;
+  }
+}
+
+// allocation of the inline items moved out of array_holder is the only one that can fail here
+inline void value_holder::take_items(value_holder& src) {
+  if (src.owns_items()) {
+    src.type_ = static_cast<uint64_t>(value_type::null);
+  } else if (src.holder_items()) {
+    auto& array = static_cast<array_holder&>(src);
+    payload_.items = array.items.release();
+    extra_ = kOwnedItems;
+    array.sync();
+  }
+}
+
+inline value_holder::value_holder(value_holder&& src) noexcept
+    : payload_(src.payload_), size_(src.size_), extra_(src.extra_), type_(src.type_) {
+  take_items(src);
+}
+
+inline value_holder::value_holder(array_holder&& value)
+    : payload_(value.payload_), size_(value.size_), extra_(value.extra_), type_(value.type_) {
+  take_items(value);
+}
+
+inline items_buffer::items_buffer(const items_buffer& src) {
+  reserve(src.size_);
+  try {
+    for (const auto& value : src) {
+      new (items_ + size_) value_holder(value);
+      ++size_;
+    }
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+inline items_buffer::items_buffer(items_buffer&& src) noexcept {
+  if (src.is_inline()) {
+    for (size_t index = 0; index < src.size_; ++index) {
+      new (items_ + index) value_holder(std::move(src.items_[index]));
+    }
+    size_ = src.size_;
+    src.clear();
+    return;
+  }
+  items_ = src.items_;
+  size_ = src.size_;
+  capacity_ = src.capacity_;
+  src.items_ = src.inline_items();
+  src.size_ = 0;
+  src.capacity_ = inline_capacity;
+}
+
+inline void items_buffer::reserve(const size_t capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  auto* items = static_cast<value_holder*>(::operator new(capacity * sizeof(value_holder)));
+  for (size_t index = 0; index < size_; ++index) {
+    new (items + index) value_holder(std::move(items_[index]));
+    items_[index].~value_holder();
+  }
+  if (!is_inline()) {
+    ::operator delete(items_);
+  }
+  items_ = items;
+  capacity_ = capacity;
+}
+
+template <typename... ARGS>
+value_holder& items_buffer::emplace_back(ARGS&&... args) {
+  if (size_ == capacity_) {
+    // arguments may reference the items that move on growth
+    value_holder value(std::forward<ARGS>(args)...);
+    grow();
+    return *new (items_ + size_++) value_holder(std::move(value));
+  }
+  return *new (items_ + size_++) value_holder(std::forward<ARGS>(args)...);
+}
+
+inline void items_buffer::push_back(const value_holder& value) {
+  emplace_back(value);
+}
+
+inline void items_buffer::push_back(value_holder&& value) {
+  emplace_back(std::move(value));
+}
+
+inline void items_buffer::clear() noexcept {
+  if (is_inline()) {
+    for (size_t index = 0; index < size_; ++index) {
+      items_[index].~value_holder();
+    }
+  } else {
+    free_items(items_, size_);
+  }
+  items_ = inline_items();
+  size_ = 0;
+  capacity_ = inline_capacity;
+}
+
+inline value_holder* items_buffer::release() {
+  if (0 == size_) {
+    clear();
+    return nullptr;
+  }
+  value_holder* items = items_;
+  if (is_inline()) {
+    items = static_cast<value_holder*>(::operator new(size_ * sizeof(value_holder)));
+    for (size_t index = 0; index < size_; ++index) {
+      new (items + index) value_holder(std::move(items_[index]));
+      items_[index].~value_holder();
+    }
+  }
+  items_ = inline_items();
+  size_ = 0;
+  capacity_ = inline_capacity;
+  return items;
+}
+
+inline void items_buffer::grow() {
+  reserve(capacity_ * 2);
+}
+
+inline value_holder* copy_items(const value_holder* items, const size_t size) {
+  auto* copy = static_cast<value_holder*>(::operator new(size * sizeof(value_holder)));
+  size_t index = 0;
+  try {
+    for (; index < size; ++index) {
+      new (copy + index) value_holder(items[index]);
+    }
+  } catch (...) {
+    free_items(copy, index);
+    throw;
+  }
+  return copy;
+}
+
+inline void free_items(value_holder* items, const size_t size) noexcept {
+  for (size_t index = 0; index < size; ++index) {
+    items[index].~value_holder();
+  }
+  ::operator delete(items);
+}
+
+/**
+ * \brief projection that passes range elements as is
+ */
+struct identity final {
+  template <typename T>
+  constexpr T&& operator()(T&& value) const noexcept {
+    return std::forward<T>(value);
+  }
+};
+
+/**
+ * \brief lazy array over the iterator pair, every element is passed through the projection while building
+ */
+template <typename ITERATOR, typename PROJECTION>
+struct range_holder final : lazy_array_holder {
+  range_holder(ITERATOR range_begin, ITERATOR range_end, PROJECTION range_projection)
+      : lazy_array_holder{&enumerate},
+        begin(std::move(range_begin)),
+        end(std::move(range_end)),
+        projection(std::move(range_projection)) {}
+
+  static void enumerate(const lazy_array_holder& source, visitor visit, void* context) {
+    const auto& range = static_cast<const range_holder&>(source);
+    for (auto it = range.begin; it != range.end; ++it) {
+      if (!visit(context, value_holder(std::invoke(range.projection, *it)))) {
+        return;
+      }
+    }
+  }
+
+  ITERATOR begin;
+  ITERATOR end;
+  PROJECTION projection;
+};
 
-  // array from initializer_list or container, safe to move out from
-  // array_holder, because it's our internal structure
-  value_holder(array_holder&& value) noexcept : holder(std::move(value)) {}
+/**
+ * \brief lazy array of count elements produced by generator(index) while building
+ */
+template <typename GENERATOR>
+struct generator_holder final : lazy_array_holder {
+  generator_holder(size_t generator_count, GENERATOR generator_function)
+      : lazy_array_holder{&enumerate}, count(generator_count), generator(std::move(generator_function)) {}
 
-  // copy constructor
-  value_holder(const value_holder& src) = default;
-  // move constructor
-  value_holder(value_holder&& src) = default;
-  ~value_holder() = default;
+  static void enumerate(const lazy_array_holder& source, visitor visit, void* context) {
+    const auto& holder = static_cast<const generator_holder&>(source);
+    for (size_t index = 0; index < holder.count; ++index) {
+      if (!visit(context, value_holder(std::invoke(holder.generator, index)))) {
+        return;
+      }
+    }
+  }
 
-  const std::variant<std::nullptr_t,
-                     std::string_view,
-                     int64_t,
-                     uint64_t,
-                     double,
-                     bool,
-                     std::initializer_list<field_holder>,
-                     array_holder>
-      holder;
+  size_t count;
+  GENERATOR generator;
 };
 
 }  // namespace builder
 
+/**
+ * \brief fields of the struct for json::object and json::array, specialize it with the static constexpr tuple of
+ * json::member named fields:
+ *
+ *   template <>
+ *   struct json::describe<order> {
+ *     static constexpr auto fields =
+ *         std::make_tuple(json::member("id", &order::id), json::member("name", &order::name));
+ *   };
+ */
+template <typename T>
+struct describe;
+
 /**
  * \brief helper function to convert container explicitly to Array
  */
@@ -194,23 +799,52 @@ struct has_size<T, std::void_t<decltype(std::declval<const T&>().size())>> : std
 
 template <typename T>
 inline constexpr bool has_size_v = has_size<T>::value;
+
+template <typename T, typename = void>
+struct is_range : std::false_type {};
+
+template <typename T>
+struct is_range<T, std::void_t<decltype(std::begin(std::declval<const T&>()))>> : std::true_type {};
+
+template <typename T>
+inline constexpr bool is_range_v = is_range<T>::value;
+
+template <typename T, typename = void>
+struct is_described : std::false_type {};
+
+template <typename T>
+struct is_described<T, std::void_t<decltype(describe<T>::fields)>> : std::true_type {};
+
+template <typename T>
+inline constexpr bool is_described_v = is_described<T>::value;
+
+template <typename T, typename = void>
+struct has_described_items : std::false_type {};
+
+template <typename T>
+struct has_described_items<T, std::enable_if_t<is_range_v<T>>>
+    : is_described<std::decay_t<decltype(*std::begin(std::declval<const T&>()))>> {};
+
+template <typename T>
+inline constexpr bool has_described_items_v = has_described_items<T>::value;
 }  // namespace detail
 
-template <typename CONTAINER>
+template <typename CONTAINER,
+          typename = std::enable_if_t<!detail::has_described_items_v<std::remove_reference_t<CONTAINER>>>>
 builder::array_holder array(CONTAINER&& container) {
   builder::array_holder array_value;
 
   if constexpr (detail::has_size_v<std::decay_t<CONTAINER>>) {
-    array_value.items.reserve(static_cast<size_t>(container.size()));
+    array_value.reserve(static_cast<size_t>(container.size()));
   }
 
   if constexpr (std::is_rvalue_reference_v<CONTAINER&&>) {
     for (auto&& value : container) {
-      array_value.items.emplace_back(std::move(value));
+      array_value.emplace_back(std::move(value));
     }
   } else {
     for (const auto& value : container) {
-      array_value.items.emplace_back(value);
+      array_value.emplace_back(value);
     }
   }
   return array_value;
@@ -223,23 +857,1150 @@ builder::array_holder array(CONTAINER&& container) {
 builder::array_holder array(std::initializer_list<builder::value_holder> list);
 
 /**
- * \brief build json string
+ * \brief lazy array over the container, elements are converted (through the optional projection) while building,
+ * nothing is copied. Container and projection must outlive the build call. Projection may return temporaries by
+ * value, they live until the element is written, but not initializer lists of values or fields
+ */
+template <typename RANGE,
+          typename PROJECTION = builder::identity,
+          typename = std::enable_if_t<detail::is_range_v<RANGE>>>
+builder::range_holder<decltype(std::begin(std::declval<const RANGE&>())), PROJECTION> range(
+    const RANGE& source,
+    PROJECTION projection = {}) {
+  return {std::begin(source), std::end(source), std::move(projection)};
+}
+
+/**
+ * \brief lazy array over the iterator pair, elements are converted (through the optional projection) while building
  */
-std::string build(const builder::value_holder& value);
+template <typename ITERATOR,
+          typename PROJECTION = builder::identity,
+          typename = std::enable_if_t<!detail::is_range_v<ITERATOR>>>
+builder::range_holder<ITERATOR, PROJECTION> range(ITERATOR begin, ITERATOR end, PROJECTION projection = {}) {
+  return {std::move(begin), std::move(end), std::move(projection)};
+}
 
 /**
- * \brief build rapidjson value (array or object)
+ * \brief lazy array of count elements, generator(index) is called for every element while building
  */
-rapidjson::Value build_value(const builder::value_holder& value, rapidjson::Document::AllocatorType& allocator);
+template <typename GENERATOR>
+builder::generator_holder<GENERATOR> generate(size_t count, GENERATOR generator) {
+  return {count, std::move(generator)};
+}
 
 /**
- * \brief build rapidjson document with array or object
+ * \brief numeric array over size integers, floats or doubles at data. Elements are formatted in batches with the
+ * vectorized integer formatter, much faster than json::array for large buffers. Memory must outlive the build call.
+ * Non finite floating point values are written as null
  */
-rapidjson::Document build_document(const builder::value_holder& value);
+template <typename T>
+builder::number_array_holder numbers(const T* data, size_t size) {
+  return {data, size, builder::number_type_of<T>()};
+}
 
 /**
- * \brief build json string from rapidjson document
+ * \brief numeric array over the contiguous container (std::vector, std::array, C array...)
  */
-std::string stringify(const rapidjson::Document& document);
+template <typename CONTAINER>
+auto numbers(const CONTAINER& container) -> decltype(numbers(std::data(container), std::size(container))) {
+  return numbers(std::data(container), std::size(container));
+}
+
+namespace detail {
+template <typename T, typename = void>
+struct is_number_container : std::false_type {};
+
+template <typename T>
+struct is_number_container<T, std::void_t<decltype(std::data(std::declval<const T&>()))>> {
+  using item_type = std::remove_cv_t<std::remove_pointer_t<decltype(std::data(std::declval<const T&>()))>>;
+  static constexpr bool value = std::is_arithmetic_v<item_type> && !std::is_same_v<item_type, bool> &&
+                                !std::is_same_v<item_type, long double>;
+};
+
+// map or other container of pairs with string keys
+template <typename T, typename = void>
+struct is_key_value_range : std::false_type {};
+
+template <typename T>
+struct is_key_value_range<T, std::void_t<decltype(std::begin(std::declval<const T&>())->second)>>
+    : std::is_convertible<decltype(std::begin(std::declval<const T&>())->first), std::string_view> {};
+
+template <typename T>
+inline constexpr bool is_key_value_range_v = is_key_value_range<T>::value;
+
+template <typename T>
+struct record_table;
+
+template <typename T>
+decltype(auto) field_value(const T& value);
+}  // namespace detail
+
+/**
+ * \brief order of the fields of the object from container
+ */
+enum class key_order : uint8_t {
+  // iteration order of the container
+  container,
+  // keys sorted by bytes, equal keys keep the container order
+  sorted
+};
+
+namespace builder {
+/**
+ * \brief lazy object over the container of key value pairs, values are converted like the described struct fields
+ */
+template <typename CONTAINER>
+struct map_holder final : lazy_object_holder {
+  map_holder(const CONTAINER& source, const key_order fields_order)
+      : lazy_object_holder{&enumerate, static_cast<size_t>(std::size(source))},
+        container(&source),
+        order(fields_order) {}
+
+  static void enumerate(const lazy_object_holder& source, visitor visit, void* context) {
+    const auto& holder = static_cast<const map_holder&>(source);
+    if (key_order::container == holder.order) {
+      for (const auto& item : *holder.container) {
+        if (!visit(context, std::string_view(item.first), value_holder(detail::field_value(item.second)))) {
+          return;
+        }
+      }
+      return;
+    }
+    // sorted pointers to the items, the container is not touched
+    using item_type = std::remove_reference_t<decltype(*std::begin(*holder.container))>;
+    std::vector<item_type*> items;
+    items.reserve(holder.size);
+    for (auto& item : *holder.container) {
+      items.push_back(&item);
+    }
+    std::stable_sort(items.begin(), items.end(), [](const item_type* left, const item_type* right) {
+      return std::string_view(left->first) < std::string_view(right->first);
+    });
+    for (const item_type* item : items) {
+      if (!visit(context, std::string_view(item->first), value_holder(detail::field_value(item->second)))) {
+        return;
+      }
+    }
+  }
+
+  const CONTAINER* container;
+  key_order order;
+};
+}  // namespace builder
+
+namespace detail {
+/**
+ * \brief value of the described struct field or map value: values as is, described structs and maps as objects,
+ * contiguous numbers as numeric arrays and other containers as lazy arrays of the same conversions
+ */
+template <typename T>
+decltype(auto) field_value(const T& value) {
+  if constexpr (is_described_v<T>) {
+    return builder::record_holder{&value, &record_table<T>::type};
+  } else if constexpr (std::is_constructible_v<builder::value_holder, const T&>) {
+    return (value);
+  } else if constexpr (is_number_container<T>::value) {
+    return numbers(value);
+  } else if constexpr (is_key_value_range_v<T>) {
+    return builder::map_holder<T>(value, key_order::container);
+  } else {
+    static_assert(is_range_v<T>, "field type is not supported, describe it or convert with own getter");
+    return range(value, [](const auto& item) -> decltype(auto) { return field_value(item); });
+  }
+}
+
+/**
+ * \brief fields table of the described struct, built at compile time from describe<T>::fields
+ */
+template <typename T>
+struct record_table final {
+  using fields_type = std::remove_cv_t<decltype(describe<T>::fields)>;
+  static constexpr size_t size = std::tuple_size_v<fields_type>;
+
+  template <size_t I>
+  static void visit_field(const void* object, builder::lazy_array_holder::visitor visit, void* context) {
+    const auto& member = std::get<I>(describe<T>::fields);
+    visit(context, builder::value_holder(field_value(static_cast<const T*>(object)->*member.pointer)));
+  }
+
+  template <size_t... I>
+  static constexpr std::array<builder::record_field, size> make_fields(std::index_sequence<I...>) {
+    return {{{std::get<I>(describe<T>::fields).name, std::get<I>(describe<T>::fields).key(), &visit_field<I>}...}};
+  }
+
+  static const std::array<builder::record_field, size> fields;
+  static const builder::record_type type;
+};
+
+// constant initialization, tables are in the static data
+template <typename T>
+const std::array<builder::record_field, record_table<T>::size> record_table<T>::fields =
+    record_table<T>::make_fields(std::make_index_sequence<record_table<T>::size>());
+
+template <typename T>
+const builder::record_type record_table<T>::type{record_table<T>::fields.data(), record_table<T>::size};
+}  // namespace detail
+
+/**
+ * \brief object of the described struct (see json::describe), fields are written right from the struct with the keys
+ * escaped at compile time. Struct must outlive the build call
+ */
+template <typename T, typename = std::enable_if_t<detail::is_described_v<T>>>
+builder::record_holder object(const T& value) noexcept {
+  return {&value, &detail::record_table<T>::type};
+}
+
+/**
+ * \brief lazy object over the map or other container of pairs with string keys, fields are written from the container
+ * while building, nothing is copied. Values are converted like the described struct fields. Sorted order takes the
+ * temporary array of pointers to the items. Container must outlive the build call
+ */
+template <typename CONTAINER,
+          typename = std::enable_if_t<detail::is_key_value_range_v<CONTAINER> && !detail::is_described_v<CONTAINER>>>
+builder::map_holder<CONTAINER> object(const CONTAINER& container, const key_order order = key_order::container) {
+  return {container, order};
+}
+
+/**
+ * \brief lazy array of the described structs, every row is written as json::object(row). Container must outlive the
+ * build call
+ */
+template <typename CONTAINER,
+          typename = std::enable_if_t<detail::has_described_items_v<std::remove_reference_t<CONTAINER>>>,
+          typename = void>
+auto array(CONTAINER&& container) {
+  static_assert(std::is_lvalue_reference_v<CONTAINER>, "rows are read while building, container must outlive it");
+  return range(container, [](const auto& row) { return object(row); });
+}
+
+/**
+ * \brief floating point value written with the format, overrides build_options::floats
+ */
+template <typename T, typename = std::enable_if_t<std::is_floating_point_v<T>>>
+builder::float_holder formatted(const T value, const float_format& format) noexcept {
+  static_assert(!std::is_same_v<T, long double>, "long double is not supported");
+  return {static_cast<double>(value), format, std::is_same_v<T, float>};
+}
+
+/**
+ * \brief shortest text that parses back to the same value, float stays float: 0.1f is written as 0.1
+ */
+template <typename T, typename = std::enable_if_t<std::is_floating_point_v<T>>>
+builder::float_holder shortest(const T value) noexcept {
+  return formatted(value, {float_mode::shortest, 0});
+}
+
+/**
+ * \brief value with the decimals digits after the decimal point
+ */
+template <typename T, typename = std::enable_if_t<std::is_floating_point_v<T>>>
+builder::float_holder fixed(const T value, const int decimals) noexcept {
+  return formatted(value, {float_mode::fixed, decimals});
+}
+
+/**
+ * \brief value with at most digits significant digits
+ */
+template <typename T, typename = std::enable_if_t<std::is_floating_point_v<T>>>
+builder::float_holder significant(const T value, const int digits) noexcept {
+  return formatted(value, {float_mode::significant, digits});
+}
+
+/**
+ * \brief positional placeholder for json::prepare, filled by the argument with this index
+ */
+inline builder::placeholder_holder placeholder(size_t index) noexcept {
+  return {std::string_view(), index};
+}
+
+/**
+ * \brief named placeholder for json::prepare, filled by the argument with this name
+ */
+inline builder::placeholder_holder placeholder(std::string_view name) {
+  RAPIDJSON_ASSERT(nullptr != name.data());
+  return {name, 0};
+}
+
+/**
+ * \brief json text spliced into the output as is, without parsing: cached responses or blobs from other services.
+ * Text must be a single valid json value and must outlive the build call. build_document and emit parse it in the
+ * value place
+ */
+constexpr builder::raw_holder raw(const std::string_view text) noexcept {
+  return {text};
+}
+
+/**
+ * \brief options for the json string build
+ */
+struct build_options final {
+  // measure the output first (see json::measure) and allocate the string exactly once
+  bool exact_size{false};
+  // json::build reserves the result for the size of the previous build on this thread (see
+  // build_context::size_hint), builds of the same size allocate the result string once
+  bool thread_context{true};
+  // format of the double and float values and numeric arrays, values from json::formatted keep own format
+  float_format floats{};
+  // arrays and objects nested deeper than this fail the build with std::runtime_error, 0 means no limit. Nesting
+  // does not take the native stack (except lazy arrays and described structs), so the limit is for the untrusted
+  // trees only
+  size_t max_depth{0};
+  // threads that write the large arrays in chunks: the calling one and the shared workers. Output is the same as the
+  // serial one, 0 and 1 mean the serial build
+  size_t parallel_threads{0};
+  // arrays from containers and initializer lists with at least this many items are written in parallel, they are
+  // looked for in the top levels of the tree
+  size_t parallel_threshold{16 * 1024};
+};
+
+namespace detail {
+// writes static text fragments of the compiled shape with the slot values between them, ends has values.size() + 1
+// fragment ends
+void build_shape_into(std::string& output,
+                      std::string_view text,
+                      const size_t* ends,
+                      std::initializer_list<builder::value_holder> values);
+}  // namespace detail
+
+/**
+ * \brief reusable build state: output buffer is kept warm between builds, so builds with the same context don't
+ * allocate once the buffer reaches the json size. One context is for one thread at a time
+ */
+class build_context final {
+ public:
+  build_context();
+  build_context(const build_context&) = delete;
+  build_context& operator=(const build_context&) = delete;
+  ~build_context();
+
+  /**
+   * \brief build json into the context buffer, returned view is valid until the next build with this context
+   */
+  std::string_view build(const builder::value_holder& value, const build_options& options = {});
+
+  /**
+   * \brief build json into the caller owned string, previous content is replaced. Same as json::build_into
+   */
+  void build_into(std::string& output, const builder::value_holder& value, const build_options& options = {});
+
+  /**
+   * \brief build json and append it to the caller owned string. Same as json::build_append
+   */
+  void build_append(std::string& output, const builder::value_holder& value, const build_options& options = {});
+
+  /**
+   * \brief context is building right now (nested build from the lazy array generator)
+   */
+  bool busy() const noexcept;
+
+  /**
+   * \brief size of the last json built with this context, json::build reserves it for the result
+   */
+  size_t size_hint() const noexcept;
+
+  /**
+   * \brief free the buffer if its capacity exceeds max_capacity
+   */
+  void trim(size_t max_capacity) noexcept;
+
+  /**
+   * \brief context of the calling thread, used by json::build with build_options::thread_context
+   */
+  static build_context& for_thread();
+
+  /**
+   * \brief buffer capacity that thread buffers keep between builds, larger buffers are freed. json::build reserves
+   * no more than this
+   */
+  static constexpr size_t thread_capacity = 1024 * 1024;
+
+ private:
+  struct state;
+  std::unique_ptr<state> state_;
+};
+
+/**
+ * \brief build json string
+ */
+std::string build(const builder::value_holder& value, const build_options& options = {});
+
+/**
+ * \brief build json string into the caller owned string, previous content is replaced. Capacity of the string is
+ * kept, so the same string can be reused for many builds without new allocations
+ */
+void build_into(std::string& output, const builder::value_holder& value, const build_options& options = {});
+
+/**
+ * \brief build json string and append it to the caller owned string
+ */
+void build_append(std::string& output, const builder::value_holder& value, const build_options& options = {});
+
+/**
+ * \brief exact size in bytes of the json string that build() produces for the value with the same floats format,
+ * nothing is written
+ */
+size_t measure(const builder::value_holder& value, const float_format& floats = {});
+
+/**
+ * \brief build json string into the reusable rapidjson buffer, previous content is replaced. Returned view points to
+ * the buffer memory and stays valid until the buffer is modified
+ */
+std::string_view build(rapidjson::StringBuffer& buffer, const builder::value_holder& value);
+
+/**
+ * \brief MessagePack encoding of the value from the same tree, integers, strings, arrays and maps take the shortest
+ * form for the value. Doubles are float 64 and floats (json::shortest(float), float numeric arrays) float 32, float
+ * formats are for json text only. json::raw text is parsed. Nesting deeper than max_depth (0 means no limit) throws
+ */
+std::string build_msgpack(const builder::value_holder& value, size_t max_depth = 0);
+
+/**
+ * \brief MessagePack encoding into the caller owned string, previous content is replaced
+ */
+void build_msgpack_into(std::string& output, const builder::value_holder& value, size_t max_depth = 0);
+
+/**
+ * \brief CBOR encoding of the value, same as build_msgpack. Doubles that float keeps exactly are float 32
+ */
+std::string build_cbor(const builder::value_holder& value, size_t max_depth = 0);
+
+/**
+ * \brief CBOR encoding into the caller owned string, previous content is replaced
+ */
+void build_cbor_into(std::string& output, const builder::value_holder& value, size_t max_depth = 0);
+
+/**
+ * \brief json text of the subtrees by key and version for json::cached, bounded by the bytes of the texts and keys.
+ * Lookups share the lock and run in parallel, stores take it exclusively. Entries are evicted in the second chance
+ * (CLOCK) order: the oldest stored entry goes unless it was hit since the last pass, hit ones get one more round
+ */
+class fragment_cache final {
+ public:
+  static constexpr size_t default_max_bytes = 16 * 1024 * 1024;
+
+  explicit fragment_cache(size_t max_bytes = default_max_bytes);
+  fragment_cache(const fragment_cache&) = delete;
+  fragment_cache& operator=(const fragment_cache&) = delete;
+  ~fragment_cache();
+
+  // lookups that found the same version and that built the text
+  size_t hits() const noexcept;
+  size_t misses() const noexcept;
+  // entries and bytes of their texts and keys
+  size_t size() const;
+  size_t bytes() const;
+  // drops all entries, texts in use stay valid
+  void clear();
+
+ private:
+  friend builder::cached_holder cached(fragment_cache& cache,
+                                       std::string_view key,
+                                       uint64_t version,
+                                       const builder::value_holder& value,
+                                       const build_options& options);
+
+  struct state;
+  std::unique_ptr<state> state_;
+};
+
+/**
+ * \brief subtree with the version, text of the same key and version is taken from the cache, other version is built
+ * with the options and replaces the cached one. Key is unique for the cache, version changes with the subtree. Result
+ * goes to the build like json::raw, build_document parses it
+ */
+builder::cached_holder cached(fragment_cache& cache,
+                              std::string_view key,
+                              uint64_t version,
+                              const builder::value_holder& value,
+                              const build_options& options = {});
+
+/**
+ * \brief json strings of the batch in one buffer, message N is text[offsets[N], offsets[N + 1])
+ */
+struct build_batch final {
+  std::string text;
+  std::vector<size_t> offsets;
+
+  size_t size() const noexcept { return offsets.empty() ? 0 : offsets.size() - 1; }
+  std::string_view operator[](const size_t index) const noexcept {
+    return std::string_view(text).substr(offsets[index], offsets[index + 1] - offsets[index]);
+  }
+};
+
+namespace detail {
+// derived holders (array_holder, cached_holder) are larger than value_holder, pointers to them convert to value_holder
+// pointers silently but arrays of them are not arrays of values
+template <typename T>
+inline constexpr bool is_derived_holder_v =
+    std::is_base_of_v<builder::value_holder, T> && !std::is_same_v<std::remove_cv_t<T>, builder::value_holder>;
+
+// contiguous container of value_holder, the element type is exact
+template <typename CONTAINER, typename = void>
+struct is_values_container : std::false_type {};
+
+template <typename CONTAINER>
+struct is_values_container<CONTAINER, std::void_t<decltype(std::data(std::declval<const CONTAINER&>()))>>
+    : std::is_same<std::remove_cv_t<std::remove_pointer_t<decltype(std::data(std::declval<const CONTAINER&>()))>>,
+                   builder::value_holder> {};
+
+template <typename CONTAINER>
+inline constexpr bool is_values_container_v = is_values_container<CONTAINER>::value;
+}  // namespace detail
+
+/**
+ * \brief build json strings of count independent values on threads threads (0 means all hardware threads): the calling
+ * one and the shared workers take the messages in chunks, every worker writes into the reused buffer and the buffers
+ * are joined into one text. Previous content of the batch is replaced, its capacity is kept. values is the array of
+ * value_holder exactly, arrays of derived holders are rejected at compile time
+ */
+void build_many_into(build_batch& batch,
+                     const builder::value_holder* values,
+                     size_t count,
+                     const build_options& options = {},
+                     size_t threads = 0);
+
+template <typename T, typename = std::enable_if_t<detail::is_derived_holder_v<T>>>
+void build_many_into(build_batch&, const T*, size_t, const build_options& = {}, size_t = 0) = delete;
+
+/**
+ * \brief build json strings of the independent values in one buffer
+ */
+build_batch build_many(const builder::value_holder* values,
+                       size_t count,
+                       const build_options& options = {},
+                       size_t threads = 0);
+
+template <typename T, typename = std::enable_if_t<detail::is_derived_holder_v<T>>>
+build_batch build_many(const T*, size_t, const build_options& = {}, size_t = 0) = delete;
+
+/**
+ * \brief build json strings of the contiguous container of values (std::vector, std::array...) in one buffer
+ */
+template <typename CONTAINER, typename = std::enable_if_t<detail::is_values_container_v<CONTAINER>>>
+build_batch build_many(const CONTAINER& values, const build_options& options = {}, size_t threads = 0) {
+  return build_many(std::data(values), std::size(values), options, threads);
+}
+
+/**
+ * \brief build json strings of the independent values like build_many and append them to the caller owned string,
+ * every one is followed by '\n' (newline delimited json)
+ */
+void build_many_lines(std::string& output,
+                      const builder::value_holder* values,
+                      size_t count,
+                      const build_options& options = {},
+                      size_t threads = 0);
+
+template <typename T, typename = std::enable_if_t<detail::is_derived_holder_v<T>>>
+void build_many_lines(std::string&, const T*, size_t, const build_options& = {}, size_t = 0) = delete;
+
+/**
+ * \brief newline delimited json of the contiguous container of values
+ */
+template <typename CONTAINER, typename = std::enable_if_t<detail::is_values_container_v<CONTAINER>>>
+void build_many_lines(std::string& output,
+                      const CONTAINER& values,
+                      const build_options& options = {},
+                      size_t threads = 0) {
+  build_many_lines(output, std::data(values), std::size(values), options, threads);
+}
+
+/**
+ * \brief receiver of the streaming build output, called with every filled chunk and with the final tail
+ */
+using sink_function = std::function<void(std::string_view chunk)>;
+
+/**
+ * \brief default size of the chunk buffer used by the streaming build
+ */
+inline constexpr size_t default_chunk_size = 64 * 1024;
+
+/**
+ * \brief build json and stream it to the sink in chunks of at most chunk_size bytes, memory usage does not depend
+ * on the output size
+ */
+void build_to(const sink_function& sink,
+              const builder::value_holder& value,
+              size_t chunk_size = default_chunk_size);
+
+/**
+ * \brief build json and stream it to std::ostream in chunks, throws std::runtime_error if the stream fails
+ */
+void build_to(std::ostream& stream, const builder::value_holder& value, size_t chunk_size = default_chunk_size);
+
+/**
+ * \brief build json and stream it to FILE* in chunks, throws std::runtime_error on write error
+ */
+void build_to(std::FILE* file, const builder::value_holder& value, size_t chunk_size = default_chunk_size);
+
+/**
+ * \brief build json and stream it to the file descriptor in chunks, throws std::runtime_error on write error
+ */
+void build_to(int fd, const builder::value_holder& value, size_t chunk_size = default_chunk_size);
+
+/**
+ * \brief flush policy of the json lines writer
+ */
+struct lines_options final {
+  // buffer is flushed when it reaches this size, memory usage is this plus the largest record
+  size_t flush_bytes{default_chunk_size};
+  // buffer is flushed after this many records, 0 means no limit
+  size_t flush_records{0};
+  // options of every record build
+  build_options build{};
+};
+
+/**
+ * \brief json lines (newline delimited json) writer: records are built straight into the shared buffer, every one is
+ * followed by '\n', and the buffer goes to the sink with one write per flush. Sink errors are thrown from write() and
+ * flush(), the buffer is kept then. Destructor flushes the rest and drops the sink error, so call flush() to get it
+ */
+class lines_writer final {
+ public:
+  explicit lines_writer(sink_function sink, const lines_options& options = {});
+  explicit lines_writer(std::ostream& stream, const lines_options& options = {});
+  explicit lines_writer(std::FILE* file, const lines_options& options = {});
+  explicit lines_writer(int fd, const lines_options& options = {});
+  lines_writer(const lines_writer&) = delete;
+  lines_writer& operator=(const lines_writer&) = delete;
+  ~lines_writer();
+
+  /**
+   * \brief append the record, failed build leaves nothing in the buffer. Flushes if a limit is reached
+   */
+  void write(const builder::value_holder& record);
+
+  /**
+   * \brief pass the buffered records to the sink with one call
+   */
+  void flush();
+
+  /**
+   * \brief records and bytes waiting for the flush
+   */
+  size_t pending_records() const noexcept { return records_; }
+  size_t pending_bytes() const noexcept { return buffer_.size(); }
+
+ private:
+  sink_function sink_;
+  const lines_options options_;
+  std::string buffer_;
+  size_t records_{0};
+};
+
+/**
+ * \brief options for the rapidjson value and document build
+ */
+struct document_options final {
+  // copy all strings and keys into the document allocator with one allocation, result does not depend on the source
+  // strings. Otherwise strings and keys are referenced
+  bool copy_strings{false};
+  // same as build_options::max_depth
+  size_t max_depth{0};
+};
+
+/**
+ * \brief build rapidjson value (array or object), arrays and objects are allocated once with the exact size
+ */
+rapidjson::Value build_value(const builder::value_holder& value,
+                             rapidjson::Document::AllocatorType& allocator,
+                             const document_options& options = {});
+
+/**
+ * \brief build rapidjson document with array or object
+ */
+rapidjson::Document build_document(const builder::value_holder& value, const document_options& options = {});
+
+/**
+ * \brief build array or object into the existing document, previous content is dropped and the document allocator is
+ * cleared, so no value from it may be used after the call. Rapidjson keeps only the user buffer of the allocator on
+ * clear: document over MemoryPoolAllocator with the user buffer and with the stack capacity for the whole json is
+ * rebuilt with one allocation of the stack
+ */
+void build_document(rapidjson::Document& document,
+                    const builder::value_holder& value,
+                    const document_options& options = {});
+
+namespace builder {
+/**
+ * \brief type erased rapidjson SAX handler for json::emit, calls and results are the same as rapidjson handlers have.
+ * Integers come as Int64 and Uint64 only
+ */
+class sax_target {
+ public:
+  virtual ~sax_target() = default;
+
+  virtual bool Null() = 0;
+  virtual bool Bool(bool value) = 0;
+  virtual bool Int64(int64_t value) = 0;
+  virtual bool Uint64(uint64_t value) = 0;
+  virtual bool Double(double value) = 0;
+  virtual bool String(const char* value, rapidjson::SizeType length, bool copy) = 0;
+  virtual bool StartObject() = 0;
+  virtual bool Key(const char* name, rapidjson::SizeType length, bool copy) = 0;
+  virtual bool EndObject(rapidjson::SizeType size) = 0;
+  virtual bool StartArray() = 0;
+  virtual bool EndArray(rapidjson::SizeType size) = 0;
+};
+
+/**
+ * \brief sax_target over any rapidjson SAX handler: Writer, PrettyWriter, SchemaValidator, Document or own one
+ */
+template <typename HANDLER>
+class sax_adapter final : public sax_target {
+ public:
+  explicit sax_adapter(HANDLER& handler) noexcept : handler_(handler) {}
+
+  bool Null() override { return handler_.Null(); }
+  bool Bool(const bool value) override { return handler_.Bool(value); }
+  bool Int64(const int64_t value) override { return handler_.Int64(value); }
+  bool Uint64(const uint64_t value) override { return handler_.Uint64(value); }
+  bool Double(const double value) override { return handler_.Double(value); }
+  bool String(const char* value, const rapidjson::SizeType length, const bool copy) override {
+    return handler_.String(value, length, copy);
+  }
+  bool StartObject() override { return handler_.StartObject(); }
+  bool Key(const char* name, const rapidjson::SizeType length, const bool copy) override {
+    return handler_.Key(name, length, copy);
+  }
+  bool EndObject(const rapidjson::SizeType size) override { return handler_.EndObject(size); }
+  bool StartArray() override { return handler_.StartArray(); }
+  bool EndArray(const rapidjson::SizeType size) override { return handler_.EndArray(size); }
+
+ private:
+  HANDLER& handler_;
+};
+}  // namespace builder
+
+/**
+ * \brief pass the value to the SAX handler without json text and DOM, e.g. validate it with SchemaValidator or hash it.
+ * Strings are passed with the copy flag for the lazy array elements only. Returns false as soon as the handler
+ * returns false, the rest of the value is not passed then and lazy arrays stop pulling their elements. Nesting deeper
+ * than max_depth (0 means no limit) throws std::runtime_error
+ */
+bool emit(const builder::value_holder& value, builder::sax_target& target, size_t max_depth = 0);
+
+/**
+ * \brief pass the value to any rapidjson SAX handler
+ */
+template <typename HANDLER, typename = std::enable_if_t<!std::is_base_of_v<builder::sax_target, HANDLER>>>
+bool emit(const builder::value_holder& value, HANDLER& handler, const size_t max_depth = 0) {
+  builder::sax_adapter<HANDLER> target(handler);
+  return emit(value, static_cast<builder::sax_target&>(target), max_depth);
+}
+
+/**
+ * \brief build json string from rapidjson document
+ */
+std::string stringify(const rapidjson::Document& document);
+
+/**
+ * \brief build json string from rapidjson document into the caller owned string, previous content is replaced
+ */
+void stringify_into(std::string& output, const rapidjson::Document& document);
+
+/**
+ * \brief json template prepared once from the value with placeholders: static text runs are formatted in advance,
+ * build() formats only the placeholder values. Immutable, so one template can be shared by many threads
+ */
+class prepared final {
+ public:
+  prepared() = default;
+  prepared(const prepared& src) = default;
+  prepared(prepared&& src) = default;
+  prepared& operator=(const prepared& src) = default;
+  prepared& operator=(prepared&& src) = default;
+  ~prepared() = default;
+
+  /**
+   * \brief build json string, value with index N fills json::placeholder(N)
+   */
+  template <typename... VALUES>
+  std::string build(VALUES&&... values) const {
+    std::string output;
+    build_into(output, std::forward<VALUES>(values)...);
+    return output;
+  }
+
+  /**
+   * \brief build json string into the caller owned string, previous content is replaced
+   */
+  template <typename... VALUES>
+  void build_into(std::string& output, VALUES&&... values) const {
+    build_positional_into(output, {builder::value_holder(std::forward<VALUES>(values))...});
+  }
+
+  /**
+   * \brief build json string, field with the name fills json::placeholder(name)
+   */
+  std::string build_named(std::initializer_list<builder::field_holder> values) const;
+
+  /**
+   * \brief build json string with named values into the caller owned string, previous content is replaced
+   */
+  void build_named_into(std::string& output, std::initializer_list<builder::field_holder> values) const;
+
+  /**
+   * \brief number of values that build() expects
+   */
+  size_t arguments() const noexcept { return named_ ? names_.size() : arguments_; }
+
+  /**
+   * \brief static text of the template without placeholder values
+   */
+  const std::string& static_text() const noexcept { return text_; }
+
+ private:
+  friend prepared prepare(const builder::value_holder& value);
+
+  // placeholder value goes after text_[0, text_end)
+  struct slot final {
+    size_t text_end;
+    size_t argument;
+  };
+
+  void build_positional_into(std::string& output, std::initializer_list<builder::value_holder> values) const;
+
+  std::string text_;
+  std::vector<slot> slots_;
+  std::vector<std::string> names_;
+  size_t arguments_{0};
+  bool named_{false};
+};
+
+/**
+ * \brief prepare the template from the value with json::placeholder values, all other values are formatted right
+ * away. Placeholders must be all positional or all named, named ones are numbered in the order of appearance
+ */
+prepared prepare(const builder::value_holder& value);
+
+/**
+ * \brief compile time json shapes: keys, structure and constant values are escaped and joined into the static text at
+ * compile time, only slot values are formatted while building
+ */
+namespace shape {
+
+/**
+ * \brief placeholder for the value passed to build()
+ */
+struct slot_t final {
+  static constexpr size_t capacity = 0;
+  static constexpr size_t slots = 1;
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    output.put_slot();
+  }
+};
+
+inline constexpr slot_t slot{};
+
+namespace detail {
+// same escaping as rapidjson::Writer
+template <typename OUTPUT>
+constexpr void emit_string(OUTPUT& output, const char* value, const size_t size) {
+  constexpr char hex_digits[] = "0123456789ABCDEF";
+  output.put('"');
+  for (size_t index = 0; index < size; ++index) {
+    const auto c = static_cast<unsigned char>(value[index]);
+    if ('"' == c || '\\' == c) {
+      output.put('\\');
+      output.put(static_cast<char>(c));
+    } else if (c < 0x20) {
+      output.put('\\');
+      switch (c) {
+        case '\b':
+          output.put('b');
+          break;
+        case '\t':
+          output.put('t');
+          break;
+        case '\n':
+          output.put('n');
+          break;
+        case '\f':
+          output.put('f');
+          break;
+        case '\r':
+          output.put('r');
+          break;
+        default:
+          output.put('u');
+          output.put('0');
+          output.put('0');
+          output.put(hex_digits[c >> 4]);
+          output.put(hex_digits[c & 0xF]);
+      }
+    } else {
+      output.put(static_cast<char>(c));
+    }
+  }
+  output.put('"');
+}
+}  // namespace detail
+
+/**
+ * \brief constant string
+ */
+template <size_t N>
+struct string_t final {
+  // every char may be escaped as \u00XX
+  static constexpr size_t capacity = 2 + 6 * (N - 1);
+  static constexpr size_t slots = 0;
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    detail::emit_string(output, value, N - 1);
+  }
+
+  const char* value;
+};
+
+/**
+ * \brief constant integer, T is int64_t or uint64_t
+ */
+template <typename T>
+struct integer_t final {
+  static constexpr size_t capacity = 20;
+  static constexpr size_t slots = 0;
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    uint64_t rest = static_cast<uint64_t>(value);
+    if constexpr (std::is_signed_v<T>) {
+      if (value < 0) {
+        output.put('-');
+        // negate in unsigned to handle the minimal value
+        rest = 0 - rest;
+      }
+    }
+    char digits[20]{};
+    size_t count = 0;
+    do {
+      digits[count++] = static_cast<char>('0' + rest % 10);
+      rest /= 10;
+    } while (rest > 0);
+    while (count > 0) {
+      output.put(digits[--count]);
+    }
+  }
+
+  T value;
+};
+
+/**
+ * \brief constant true, false or null
+ */
+struct literal_t final {
+  static constexpr size_t capacity = 5;
+  static constexpr size_t slots = 0;
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    for (size_t index = 0; index < size; ++index) {
+      output.put(text[index]);
+    }
+  }
+
+  const char* text;
+  size_t size;
+};
+
+namespace detail {
+template <size_t N>
+constexpr string_t<N> make_value(const char (&value)[N]) {
+  return {value};
+}
+
+// constants become shape elements, nested shapes and slots are kept as is
+template <typename T>
+constexpr auto make_value(const T& value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    return value ? literal_t{"true", 4} : literal_t{"false", 5};
+  } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+    return literal_t{"null", 4};
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    return integer_t<int64_t>{value};
+  } else if constexpr (std::is_integral_v<T>) {
+    return integer_t<uint64_t>{value};
+  } else {
+    return value;
+  }
+}
+}  // namespace detail
+
+/**
+ * \brief object field: constant name + constant value, slot or nested shape
+ */
+template <size_t N, typename VALUE>
+struct field_t final {
+  static constexpr size_t capacity = string_t<N>::capacity + 1 + VALUE::capacity;
+  static constexpr size_t slots = VALUE::slots;
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    detail::emit_string(output, name, N - 1);
+    output.put(':');
+    value.emit(output);
+  }
+
+  const char* name;
+  VALUE value;
+};
+
+/**
+ * \brief object with the fields
+ */
+template <typename... FIELDS>
+struct object_t final {
+  // braces and commas
+  static constexpr size_t capacity = 2 + sizeof...(FIELDS) + (0 + ... + FIELDS::capacity);
+  static constexpr size_t slots = (0 + ... + FIELDS::slots);
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    output.put('{');
+    std::apply(
+        [&output](const auto&... field) {
+          size_t index = 0;
+          ((index++ > 0 ? output.put(',') : void(), field.emit(output)), ...);
+        },
+        fields);
+    output.put('}');
+  }
+
+  std::tuple<FIELDS...> fields;
+};
+
+/**
+ * \brief array with the values
+ */
+template <typename... VALUES>
+struct array_t final {
+  // brackets and commas
+  static constexpr size_t capacity = 2 + sizeof...(VALUES) + (0 + ... + VALUES::capacity);
+  static constexpr size_t slots = (0 + ... + VALUES::slots);
+
+  template <typename OUTPUT>
+  constexpr void emit(OUTPUT& output) const {
+    output.put('[');
+    std::apply(
+        [&output](const auto&... value) {
+          size_t index = 0;
+          ((index++ > 0 ? output.put(',') : void(), value.emit(output)), ...);
+        },
+        values);
+    output.put(']');
+  }
+
+  std::tuple<VALUES...> values;
+};
+
+/**
+ * \brief static text of the shape split by the slots, result of compile()
+ */
+template <size_t CAPACITY, size_t SLOTS>
+struct compiled_shape final {
+  /**
+   * \brief build json string, values are written to the slots in order
+   */
+  template <typename... VALUES>
+  std::string build(VALUES&&... values) const {
+    std::string output;
+    build_into(output, std::forward<VALUES>(values)...);
+    return output;
+  }
+
+  /**
+   * \brief build json string into the caller owned string, previous content is replaced
+   */
+  template <typename... VALUES>
+  void build_into(std::string& output, VALUES&&... values) const {
+    static_assert(sizeof...(VALUES) == SLOTS, "value count must match the shape slots");
+    json::detail::build_shape_into(
+        output, std::string_view(text, size), ends, {builder::value_holder(std::forward<VALUES>(values))...});
+  }
+
+  /**
+   * \brief static text of the shape without slot values
+   */
+  constexpr std::string_view static_text() const noexcept { return std::string_view(text, size); }
+
+  // used by compile()
+  constexpr void put(const char c) { text[size++] = c; }
+  constexpr void put_slot() { ends[slot_count++] = size; }
+
+  char text[CAPACITY + 1]{};
+  size_t size{0};
+  size_t ends[SLOTS + 1]{};
+  size_t slot_count{0};
+};
+
+/**
+ * \brief object shape field with the constant name
+ */
+template <size_t N, typename VALUE>
+constexpr auto field(const char (&name)[N], const VALUE& value) {
+  return field_t<N, decltype(detail::make_value(value))>{name, detail::make_value(value)};
+}
+
+/**
+ * \brief object shape from the fields
+ */
+template <typename... FIELDS>
+constexpr object_t<FIELDS...> object(const FIELDS&... fields) {
+  return {std::tuple<FIELDS...>(fields...)};
+}
+
+/**
+ * \brief array shape from constants, slots and nested shapes
+ */
+template <typename... VALUES>
+constexpr auto array(const VALUES&... values) {
+  return array_t<decltype(detail::make_value(values))...>{std::make_tuple(detail::make_value(values)...)};
+}
+
+/**
+ * \brief escape and join static parts of the shape, use it to initialize constexpr variable
+ */
+template <typename SHAPE>
+constexpr compiled_shape<SHAPE::capacity, SHAPE::slots> compile(const SHAPE& shape) {
+  compiled_shape<SHAPE::capacity, SHAPE::slots> result{};
+  shape.emit(result);
+  result.ends[SHAPE::slots] = result.size;
+  return result;
+}
+
+}  // namespace shape
+
+/**
+ * \brief named field of the struct for json::describe, key text is escaped at compile time
+ */
+template <size_t N, typename T, typename M>
+struct member_t final {
+  // quotes, colon and every char escaped as \u00XX
+  static constexpr size_t capacity = 3 + 6 * (N - 1);
+
+  constexpr std::string_view key() const noexcept { return std::string_view(key_text, key_size); }
+
+  // used by member()
+  constexpr void put(const char c) { key_text[key_size++] = c; }
+
+  std::string_view name;
+  M T::*pointer;
+  char key_text[capacity]{};
+  size_t key_size{0};
+};
+
+/**
+ * \brief field of the struct with the constant name and the member pointer, use it in json::describe
+ */
+template <size_t N, typename T, typename M>
+constexpr member_t<N, T, M> member(const char (&name)[N], M T::*pointer) {
+  member_t<N, T, M> result{std::string_view(name, N - 1), pointer};
+  shape::detail::emit_string(result, name, N - 1);
+  result.put(':');
+  return result;
+}
 
 }  // namespace json
@@ -27,14 +27,59 @@ using ::testing::TestInfo;
 using ::testing::TestPartResult;
 using ::testing::UnitTest;
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <map>
+#include <new>
+#include <optional>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "builder.h"
 
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/writer.h>
+
+// operator new calls, tests check that the builder does not allocate
+std::atomic<uint64_t> allocations_count{0};
+
+void* operator new(size_t size) {
+  allocations_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(0 != size ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
 namespace {
 
 TEST(BasicTests, CreateJSONviadifferentAPIcalls) {
@@ -205,6 +250,93 @@ TEST(BasicTests, CreateArraysFromContainers) {
   }
 }
 
+TEST(BasicTests, KeepValueHolders) {
+  // arrays from containers own their items, holders can be kept, copied and moved
+  std::vector<json::builder::value_holder> values;
+  {
+    const std::vector<int> numbers{1, 2, 3};
+    values.emplace_back(json::array(numbers));
+    values.emplace_back(json::array(std::vector<json::builder::value_holder>{values.front(), true}));
+  }
+  values.emplace_back(values.back());
+  values.emplace_back(json::fixed(0.5f, 2));
+  values.emplace_back(json::significant(-1234.5, 3));
+  values.emplace_back("text");
+  values.emplace_back(json::array(std::vector<int>()));
+  const std::string test(R"%([[1,2,3],[[1,2,3],true],[[1,2,3],true],0.50,-1.23e+03,"text",[]])%");
+  EXPECT_EQ(json::build(json::array(values)), test);
+  // documents keep numbers, not their text
+  EXPECT_EQ(json::stringify(json::build_document(json::array(values))),
+            R"%([[1,2,3],[[1,2,3],true],[[1,2,3],true],0.5,-1234.5,"text",[]])%");
+
+  // placeholders keep the name or the index
+  const auto prepared = json::prepare(json::array({values[5], json::placeholder("name"), json::placeholder("id")}));
+  EXPECT_EQ(prepared.build_named({{"id", 7}, {"name", "n"}}), R"%(["text","n",7])%");
+  EXPECT_EQ(json::prepare({{"a", json::placeholder(1)}, {"b", json::placeholder(0)}}).build(1, 2),
+            R"%({"a":2,"b":1})%");
+
+  EXPECT_LE(sizeof(json::builder::value_holder), 16u);
+}
+
+TEST(BasicTests, SmallArraysWithoutAllocations) {
+  const std::vector<std::string> tags{"red", "green"};
+  const std::array<double, 2> coordinates{0.5, -1.25};
+  const std::list<int> pair{1, 2};
+  const std::vector<int> numbers{1, 2, 3, 4};
+  std::string output;
+  const auto build = [&]() {
+    json::build_into(output, {{"tags", json::array(tags)},
+                              {"coordinates", json::array(coordinates)},
+                              {"pair", json::array(pair)},
+                              {"numbers", json::array(numbers)}});
+  };
+  // output and thread buffers are allocated once
+  build();
+  const uint64_t before = allocations_count.load();
+  build();
+  EXPECT_EQ(allocations_count.load() - before, 0u);
+  EXPECT_EQ(output, R"%({"tags":["red","green"],"coordinates":[0.5,-1.25],"pair":[1,2],"numbers":[1,2,3,4]})%");
+
+  // longer containers spill to the heap once
+  const std::vector<int> longer{1, 2, 3, 4, 5};
+  const uint64_t spill = allocations_count.load();
+  json::build_into(output, {{"numbers", json::array(longer)}});
+  EXPECT_EQ(allocations_count.load() - spill, 1u);
+  EXPECT_EQ(output, R"%({"numbers":[1,2,3,4,5]})%");
+}
+
+TEST(BasicTests, ReserveArrayHolderItems) {
+  // reserve moves the inline and the heap items, the holder follows them
+  for (const size_t count : {2, 5}) {
+    json::builder::array_holder array;
+    std::string expected = "[";
+    for (size_t index = 0; index < count; ++index) {
+      array.emplace_back(index);
+      expected += (0 == index ? "" : ",") + std::to_string(index);
+    }
+    expected += "]";
+    array.reserve(100);
+    const json::builder::value_holder& value = array;
+    ASSERT_EQ(value.size(), count);
+    EXPECT_EQ(value.items()[count - 1].as_uint64(), count - 1);
+    EXPECT_EQ(json::build(array), expected);
+    array.emplace_back("last");
+    const json::builder::value_holder moved(std::move(array));
+    EXPECT_EQ(json::build(moved), expected.substr(0, expected.size() - 1) + R"%(,"last"])%");
+  }
+
+  // vector growth moves the values, owned items are not copied
+  const std::vector<int> numbers{1, 2, 3, 4, 5, 6};
+  std::vector<json::builder::value_holder> values;
+  values.emplace_back(json::array(numbers));
+  const json::builder::value_holder* items = values.front().items();
+  for (size_t index = 0; index < 100; ++index) {
+    values.emplace_back(json::array(numbers));
+  }
+  EXPECT_EQ(values.front().items(), items);
+  EXPECT_EQ(json::build(values.front()), "[1,2,3,4,5,6]");
+}
+
 TEST(BasicTests, CreateArrays) {
   {
     const auto json = json::build({{"name", "value", "int64_t", -123000000000, false, -0.123123123, nullptr, 0}});
@@ -272,6 +404,165 @@ TEST(BasicTests, CreateArrays) {
   }
 }
 
+TEST(BasicTests, EscapeStrings) {
+  // same text as rapidjson writer gives
+  const auto check = [](const std::string& value) {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key(value.data(), static_cast<rapidjson::SizeType>(value.size()));
+    writer.String(value.data(), static_cast<rapidjson::SizeType>(value.size()));
+    writer.EndObject();
+    const std::string expected(buffer.GetString(), buffer.GetSize());
+    EXPECT_EQ(json::build({{value, value}}), expected);
+    EXPECT_EQ(json::build({{value, value}}, {true}), expected);
+    EXPECT_EQ(json::measure({{value, value}}), expected.size());
+    std::string streamed;
+    json::build_to([&](std::string_view chunk) { streamed.append(chunk); }, {{value, value}}, 7);
+    EXPECT_EQ(streamed, expected);
+  };
+
+  // every special char at every position around the vector blocks
+  const std::string specials("\"\\\b\t\n\f\r\x01\x1F\x00", 10);
+  for (size_t size = 1; size < 70; ++size) {
+    for (size_t position = 0; position < size; ++position) {
+      for (const char special : specials) {
+        std::string value(size, 'a');
+        value[position] = special;
+        check(value);
+      }
+    }
+  }
+
+  // all bytes, chars from 0x7F up are not escaped
+  std::string all_bytes;
+  for (int c = 0; c < 256; ++c) {
+    all_bytes.push_back(static_cast<char>(c));
+  }
+  check(all_bytes);
+  check(std::string());
+  check(std::string(1000, '"'));
+  check("https://example.com/path?query=\"value\"&other=" + std::string(100, 'x') + "\n");
+}
+
+// random value trees for the differential test, every value is passed to the continuation while its initializer
+// lists are alive
+class RandomTree final {
+ public:
+  using continuation = std::function<void(const json::builder::value_holder& value)>;
+
+  explicit RandomTree(const uint64_t seed) : seed_(seed) {}
+
+  void With(const size_t depth, const continuation& next) {
+    switch (Next() % (depth > 0 ? 12 : 8)) {
+      case 0:
+        return next(nullptr);
+      case 1:
+        return next(Next() % 2 == 0);
+      case 2:
+        return next(static_cast<int64_t>(Next()) >> (Next() % 64));
+      case 3:
+        return next(Next() >> (Next() % 64));
+      case 4: {
+        // finite doubles of all magnitudes
+        double value = NAN;
+        while (!std::isfinite(value)) {
+          const uint64_t bits = (Next() << 32) ^ Next();
+          std::memcpy(&value, &bits, sizeof(value));
+        }
+        return next(value);
+      }
+      case 5:
+        return next(static_cast<double>(static_cast<int64_t>(Next() % 2000) - 1000) / 8);
+      case 6:
+        return next(String());
+      case 7:
+        numbers_.emplace_back();
+        for (size_t count = Next() % 5; count > 0; --count) {
+          numbers_.back().push_back(static_cast<int32_t>(Next()));
+        }
+        return next(json::numbers(numbers_.back()));
+      case 8:
+      case 9: {
+        const std::string& first = String();
+        const std::string& second = String();
+        return With(depth - 1, [&](const json::builder::value_holder& first_value) {
+          With(depth - 1, [&](const json::builder::value_holder& second_value) {
+            if (Next() % 3 == 0) {
+              // empty object
+              next(json::builder::value_holder{});
+            } else {
+              next({{first, first_value}, {second, second_value}});
+            }
+          });
+        });
+      }
+      default:
+        return WithArray(depth - 1, Next() % 4, {}, next);
+    }
+  }
+
+  uint64_t Next() {
+    seed_ = seed_ * 6364136223846793005 + 1442695040888963407;
+    return seed_ >> 11;
+  }
+
+ private:
+  // array of count values, collected one by one
+  void WithArray(const size_t depth,
+                 const size_t count,
+                 std::vector<json::builder::value_holder> values,
+                 const continuation& next) {
+    if (values.size() == count) {
+      return next(json::array(values));
+    }
+    With(depth, [&](const json::builder::value_holder& value) {
+      std::vector<json::builder::value_holder> more(values);
+      more.push_back(value);
+      WithArray(depth, count, std::move(more), next);
+    });
+  }
+
+  const std::string& String() {
+    static const char chars[] = "abc \"\\/\b\f\n\r\t\x01\x1F\x7F\xC3\xA9";
+    strings_.emplace_back();
+    for (size_t size = Next() % 40; size > 0; --size) {
+      strings_.back().push_back(chars[Next() % (sizeof(chars) - 1)]);
+    }
+    return strings_.back();
+  }
+
+  uint64_t seed_;
+  std::deque<std::string> strings_;
+  std::deque<std::vector<int32_t>> numbers_;
+};
+
+TEST(BasicTests, DifferentialAgainstRapidJson) {
+  RandomTree tree(1);
+  for (size_t iteration = 0; iteration < 3000; ++iteration) {
+    tree.With(4, [&](const json::builder::value_holder& value) {
+      // rapidjson writer over the same tree
+      std::string expected;
+      if (json::builder::value_type::object == value.type() || json::builder::value_type::array == value.type() ||
+          json::builder::value_type::number_array == value.type()) {
+        expected = json::stringify(json::build_document(value));
+      } else {
+        expected = json::stringify(json::build_document(json::array({value})));
+        expected = expected.substr(1, expected.size() - 2);
+      }
+      const auto built = json::build(value);
+      ASSERT_EQ(built, expected);
+      EXPECT_EQ(json::build(value, {true}), expected);
+      EXPECT_EQ(json::measure(value), expected.size());
+      rapidjson::StringBuffer buffer;
+      EXPECT_EQ(json::build(buffer, value), expected);
+      std::string streamed;
+      json::build_to([&](std::string_view chunk) { streamed.append(chunk); }, value, 1 + tree.Next() % 64);
+      EXPECT_EQ(streamed, expected);
+    });
+  }
+}
+
 TEST(BasicTests, CreateNotValidObjectWithNull) {
   EXPECT_THROW(json::build({{nullptr, -123000000000}, {"nullptr", nullptr}}), std::runtime_error);
   EXPECT_THROW(json::build_document({{nullptr, -123000000000}, {"nullptr", nullptr}}), std::runtime_error);
@@ -283,9 +574,1415 @@ TEST(BasicTests, CreateNotValidObjectWithNull) {
   EXPECT_EQ(stringified, test);
 }
 
+TEST(BasicTests, BuildIntoCallerOwnedBuffers) {
+  const std::string test(R"%({"name":"value","array":[0,1,2]})%");
+
+  // build_into replaces previous content and keeps the capacity
+  std::string output("previous content");
+  json::build_into(output, {{"name", "value"}, {"array", json::array({0, 1, 2})}});
+  EXPECT_EQ(output, test);
+  const auto capacity = output.capacity();
+  json::build_into(output, {{"name", "value"}, {"array", json::array({0, 1, 2})}});
+  EXPECT_EQ(output, test);
+  EXPECT_EQ(output.capacity(), capacity);
+
+  // build_append keeps previous content
+  std::string appended("[");
+  json::build_append(appended, {{"name", "value"}, {"array", json::array({0, 1, 2})}});
+  appended.push_back(',');
+  json::build_append(appended, json::array({}));
+  appended.push_back(']');
+  EXPECT_EQ(appended, "[" + test + ",[]]");
+
+  // reusable rapidjson buffer
+  rapidjson::StringBuffer buffer;
+  EXPECT_EQ(json::build(buffer, json::array({"a", "b"})), R"%(["a","b"])%");
+  EXPECT_EQ(json::build(buffer, {{"name", "value"}, {"array", json::array({0, 1, 2})}}), test);
+
+  // stringify into caller owned string
+  const auto document = json::build_document({{"name", "value"}, {"array", json::array({0, 1, 2})}});
+  json::stringify_into(output, document);
+  EXPECT_EQ(output, test);
+}
+
+TEST(BasicTests, MeasureMatchesBuild) {
+  std::string escaped("quote\" backslash\\ tab\t newline\n control\x01\x1f del\x7f utf8 \xd0\xb6");
+  std::vector<int64_t> values{0, 9, 10, 99, 100, -1, -9, -10, INT64_MIN, INT64_MAX};
+  std::vector<double> doubles{0.0, -0.0, 1.1, -2.5e-10, 1e30, 123456789.125, 1.0 / 3.0};
+
+  const auto check = [](const json::builder::value_holder& value) {
+    const auto json_text = json::build(value);
+    EXPECT_EQ(json::measure(value), json_text.size()) << json_text;
+    EXPECT_EQ(json::build(value, {true}), json_text);
+  };
+  check(nullptr);
+  check(true);
+  check(false);
+  check(UINT64_MAX);
+  check(escaped);
+  check(json::array({}));
+  check({{}});
+  check(json::array(values));
+  check(json::array(doubles));
+  check({{escaped, escaped},
+         {"obj", {{"some", "other"}, {"int", 0}}},
+         {"array", {{0, 1, json::array({2, 3, 4}), 5, 6, nullptr}}},
+         {"empty", json::array({})},
+         {"values", json::array(values)}});
+
+  // exact size build appends as well
+  std::string output("[");
+  json::build_append(output, json::array(values), {true});
+  EXPECT_EQ(output, "[" + json::build(json::array(values)));
+}
+
+TEST(BasicTests, CreateLazyArrays) {
+  struct point {
+    int64_t x;
+    std::string name;
+  };
+  const std::vector<point> points{{1, "one"}, {2, "two"}, {3, "three"}};
+  const std::list<std::string> list_value{"a", "b", "c"};
+  const int c_array[] = {4, 5, 6};
+
+  // range over container, iterator pair, projection by lambda and member pointer, generator
+  const auto check = [](const json::builder::value_holder& value, const std::string& test) {
+    EXPECT_EQ(json::build(value), test);
+    EXPECT_EQ(json::stringify(json::build_document(value)), test);
+    EXPECT_EQ(json::measure(value), test.size());
+  };
+  check(json::range(list_value), R"%(["a","b","c"])%");
+  check(json::range(c_array), R"%([4,5,6])%");
+  check(json::range(std::begin(c_array) + 1, std::end(c_array)), R"%([5,6])%");
+  check(json::range(points, &point::x), R"%([1,2,3])%");
+  check(json::range(points.rbegin(), points.rend(), &point::name), R"%(["three","two","one"])%");
+  check(json::range(points, [](const point& p) { return p.x * 10; }), R"%([10,20,30])%");
+  check(json::generate(4, [](size_t index) { return index * index; }), R"%([0,1,4,9])%");
+  check(json::range(std::vector<int>{}), R"%([])%");
+
+  // projection may return temporaries by value, but not initializer lists
+  check({{"names", json::range(points, [](const point& p) { return p.name + "!"; })},
+         {"nested", json::generate(2, [&](size_t) { return json::range(points, &point::x); })},
+         {"objects", json::range(points, [](const point& p) {
+           return json::array(std::vector<json::builder::value_holder>{p.x, p.name});
+         })}},
+        R"%({"names":["one!","two!","three!"],"nested":[[1,2,3],[1,2,3]],"objects":[[1,"one"],[2,"two"],[3,"three"]]})%");
+}
+
+TEST(BasicTests, CreateNumericArrays) {
+  // numeric array gives the same text as the generic array in every output
+  const auto check = [](const json::builder::value_holder& numbers, const json::builder::value_holder& generic) {
+    const auto expected = json::build(generic);
+    EXPECT_EQ(json::build(numbers), expected);
+    EXPECT_EQ(json::build(numbers, {true}), expected);
+    EXPECT_EQ(json::measure(numbers), expected.size());
+    EXPECT_EQ(json::stringify(json::build_document(numbers)), expected);
+    rapidjson::StringBuffer buffer;
+    EXPECT_EQ(json::build(buffer, numbers), expected);
+    std::string streamed;
+    json::build_to([&](std::string_view chunk) { streamed.append(chunk); }, numbers, 7);
+    EXPECT_EQ(streamed, expected);
+  };
+
+  std::vector<int64_t> int64_values{0, 1, -1, 9, 10, 99, 100, 9999, 10000, -99999999, 100000000, 9999999999999999,
+                                    10000000000000000, INT64_MAX, INT64_MIN};
+  std::vector<uint64_t> uint64_values{0, 1, 12345678, 123456789, 1234567890123456789, UINT64_MAX};
+  uint64_t seed = 1;
+  for (size_t index = 0; index < 5000; ++index) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    uint64_values.push_back(seed >> (seed % 64));
+    int64_values.push_back(static_cast<int64_t>(seed) >> (seed % 64));
+  }
+  check(json::numbers(int64_values), json::array(int64_values));
+  check(json::numbers(uint64_values), json::array(uint64_values));
+
+  const int32_t int32_values[] = {INT32_MIN, -5, 0, 7, INT32_MAX};
+  const std::array<uint32_t, 3> uint32_values{0, 4000000000, UINT32_MAX};
+  const std::vector<int16_t> int16_values{INT16_MIN, 0, INT16_MAX};
+  const std::vector<uint16_t> uint16_values{0, UINT16_MAX};
+  const std::vector<int8_t> int8_values{INT8_MIN, 0, INT8_MAX};
+  const std::vector<uint8_t> uint8_values{0, UINT8_MAX};
+  const std::vector<double> double_values{0.0, -0.0, 1.1, -2.5e-300, 1e308, 3.141592653589793, 0.1 + 0.2};
+  const std::vector<float> float_values{0.0f, 2.2f, -1e-30f, 3.4e38f};
+  check(json::numbers(int32_values), json::array(int32_values));
+  check(json::numbers(uint32_values), json::array(uint32_values));
+  check(json::numbers(int16_values), json::array(int16_values));
+  check(json::numbers(uint16_values), json::array(uint16_values));
+  check(json::numbers(int8_values), json::array(int8_values));
+  check(json::numbers(uint8_values), json::array(uint8_values));
+  check(json::numbers(double_values), json::array(double_values));
+  check(json::numbers(float_values), json::array(float_values));
+  check(json::numbers(int64_values.data() + 1, 3), json::array({1, -1, 9}));
+  check(json::numbers(std::vector<double>{}), json::array({}));
+
+  // nested and non finite values
+  const std::vector<double> non_finite{1.0, NAN, INFINITY};
+  check({{"values", json::numbers(int32_values)}, {"non_finite", json::numbers(non_finite)}},
+        {{"values", json::array(int32_values)}, {"non_finite", json::array({1.0, nullptr, nullptr})}});
+}
+
+TEST(BasicTests, CreateFormattedFloats) {
+  const auto check = [](const json::builder::value_holder& value,
+                        const std::string& expected,
+                        const json::float_format& floats = {}) {
+    EXPECT_EQ(json::build(value, {false, true, floats}), expected);
+    EXPECT_EQ(json::build(value, {true, false, floats}), expected);
+    EXPECT_EQ(json::measure(value, floats), expected.size());
+  };
+
+  // per value
+  check({{"shortest", json::shortest(0.1)},
+         {"float", json::shortest(0.1f)},
+         {"whole", json::shortest(2.0)},
+         {"large", json::shortest(1e30)},
+         {"fixed", json::fixed(1.0 / 3, 3)},
+         {"rounded", json::fixed(2.5, 0)},
+         {"significant", json::significant(1234567.0, 3)},
+         {"trailing", json::significant(0.5, 6)},
+         {"standard", 2.0}},
+        R"%({"shortest":0.1,"float":0.1,"whole":2,"large":1e+30,"fixed":0.333,"rounded":2,)%"
+        R"%("significant":1.23e+06,"trailing":0.5,"standard":2.0})%");
+  check(json::array({json::shortest(NAN), json::fixed(INFINITY, 2), json::significant(-INFINITY, 2)}),
+        "[null,null,null]");
+
+  // per build, float value is double already, values with own format keep it
+  const json::float_format shortest{json::float_mode::shortest};
+  const json::float_format fixed2{json::float_mode::fixed, 2};
+  check({{"whole", 2.0}, {"float", 0.1f}, {"own", json::fixed(0.5, 1)}},
+        R"%({"whole":2,"float":0.10000000149011612,"own":0.5})%",
+        shortest);
+  check({{"value", 1.005}, {"negative", -0.001}, {"large", 1e20}},
+        R"%({"value":1.00,"negative":-0.00,"large":100000000000000000000.00})%",
+        fixed2);
+  check(json::array({0.1, 1e-7, 123456.789}), "[0.1,1e-07,1.23e+05]", {json::float_mode::significant, 3});
+
+  // numeric arrays, floats are formatted as floats
+  const std::vector<float> floats{0.1f, 2.5f, -1e-30f, 3.4e38f};
+  const std::vector<double> doubles{1.0, NAN, 1e308, -2.5e-300};
+  check(json::numbers(floats), "[0.1,2.5,-1e-30,3.4e+38]", shortest);
+  check(json::numbers(doubles), "[1,null,1e+308,-2.5e-300]", shortest);
+  check(json::numbers(floats.data(), 3), "[0.10,2.50,-0.00]", fixed2);
+  check(json::numbers(doubles), "[1.0,null,1e308,-2.5e-300]");
+
+  // largest fixed text
+  const double max_double = std::numeric_limits<double>::max();
+  const auto max_text = json::build(json::numbers(&max_double, 1), {false, true, {json::float_mode::fixed, 30}});
+  EXPECT_EQ(max_text.size(), 2 + 309 + 1 + 30);
+  EXPECT_EQ(json::build(json::array({max_double, -max_double}), {false, true, {json::float_mode::fixed, 30}}),
+            "[" + max_text.substr(1, max_text.size() - 2) + ",-" + max_text.substr(1, max_text.size() - 2) + "]");
+
+  // precision out of range
+  EXPECT_THROW(json::build(json::array({json::fixed(1.0, 31)})), std::runtime_error);
+  EXPECT_THROW(json::build(json::array({json::significant(1.0, 0)})), std::runtime_error);
+  EXPECT_THROW(json::build(json::array({1.0}), {false, true, {json::float_mode::fixed, -1}}), std::runtime_error);
+
+  // format is for the json text only
+  EXPECT_EQ(json::stringify(json::build_document({{"value", json::fixed(1.5, 3)}, {"nan", json::shortest(NAN)}})),
+            R"%({"value":1.5,"nan":null})%");
+}
+
+// every stride float bit pattern is written with the shortest format and parsed back to the same bits
+void CheckFloatsRoundTrip(const uint64_t stride) {
+  std::vector<float> values;
+  std::string text;
+  const auto check_values = [&] {
+    json::build_into(text, json::numbers(values), {false, true, {json::float_mode::shortest}});
+    const char* position = text.data() + 1;
+    for (const float expected : values) {
+      float parsed = 0;
+      const auto result = std::from_chars(position, text.data() + text.size(), parsed);
+      ASSERT_EQ(result.ec, std::errc());
+      uint32_t expected_bits = 0;
+      uint32_t parsed_bits = 0;
+      std::memcpy(&expected_bits, &expected, sizeof(expected));
+      std::memcpy(&parsed_bits, &parsed, sizeof(parsed));
+      ASSERT_EQ(parsed_bits, expected_bits) << std::string(position, result.ptr);
+      position = result.ptr + 1;
+    }
+    values.clear();
+  };
+  for (uint64_t bits = 0; bits <= UINT32_MAX; bits += stride) {
+    const uint32_t float_bits = static_cast<uint32_t>(bits);
+    float value = 0;
+    std::memcpy(&value, &float_bits, sizeof(value));
+    if (std::isfinite(value)) {
+      values.push_back(value);
+    }
+    if (values.size() == 64 * 1024) {
+      check_values();
+    }
+  }
+  if (!values.empty()) {
+    check_values();
+  }
+}
+
+TEST(BasicTests, FloatsRoundTrip) {
+  // a million of floats all over the range, see DISABLED_FloatsRoundTripExhaustive for all of them
+  CheckFloatsRoundTrip(4099);
+
+  // doubles
+  std::vector<double> values;
+  uint64_t seed = 1;
+  while (values.size() < 100000) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    double value = 0;
+    std::memcpy(&value, &seed, sizeof(value));
+    if (std::isfinite(value)) {
+      values.push_back(value);
+    }
+  }
+  const auto text = json::build(json::numbers(values), {false, true, {json::float_mode::shortest}});
+  const char* position = text.data() + 1;
+  for (const double expected : values) {
+    double parsed = 0;
+    const auto result = std::from_chars(position, text.data() + text.size(), parsed);
+    ASSERT_EQ(result.ec, std::errc());
+    ASSERT_EQ(parsed, expected);
+    position = result.ptr + 1;
+  }
+}
+
+// all 2^32 floats, takes minutes: --gtest_also_run_disabled_tests --gtest_filter=*Exhaustive*
+TEST(BasicTests, DISABLED_FloatsRoundTripExhaustive) {
+  CheckFloatsRoundTrip(1);
+}
+
+TEST(BasicTests, CreateFromShapes) {
+  namespace shape = json::shape;
+  // static part is ready at compile time
+  static constexpr auto kShape = shape::compile(
+      shape::object(shape::field("name", shape::slot),
+                    shape::field("obj", shape::object(shape::field("some", "other"), shape::field("int", 0))),
+                    shape::field("values", shape::slot),
+                    shape::field("const", shape::array(-9223372036854775807 - 1, 18446744073709551615u, true, nullptr)),
+                    shape::field("esc\"\n\x01", shape::slot)));
+  static_assert(kShape.static_text() ==
+                R"%({"name":,"obj":{"some":"other","int":0},"values":,"const":[-9223372036854775808,18446744073709551615,true,null],"esc\"\n\u0001":})%");
+
+  const std::vector<int64_t> values{1, 2, 3};
+  const std::string name("na\"me");
+  const auto expected = json::build({{"name", name},
+                                     {"obj", {{"some", "other"}, {"int", 0}}},
+                                     {"values", json::array(values)},
+                                     {"const", json::array({INT64_MIN, UINT64_MAX, true, nullptr})},
+                                     {"esc\"\n\x01", 1.5}});
+  EXPECT_EQ(kShape.build(name, json::array(values), 1.5), expected);
+  EXPECT_EQ(kShape.build(name, json::numbers(values), 1.5), expected);
+  std::string output("previous");
+  kShape.build_into(output, std::string_view(name), json::range(values), 1.5);
+  EXPECT_EQ(output, expected);
+
+  // slots may hold objects, shape may be an array or a single slot
+  constexpr auto array_shape = shape::compile(shape::array(shape::slot, "text", shape::array(), shape::object()));
+  EXPECT_EQ(array_shape.build(json::builder::value_holder{{"a", 1}, {"b", json::array({nullptr})}}),
+            R"%([{"a":1,"b":[null]},"text",[],{}])%");
+  constexpr auto slot_shape = shape::compile(shape::slot);
+  EXPECT_EQ(slot_shape.build(42), "42");
+  constexpr auto static_shape = shape::compile(shape::object(shape::field("a", false)));
+  EXPECT_EQ(static_shape.build(), R"%({"a":false})%");
+}
+
+TEST(BasicTests, CreateFromPreparedTemplates) {
+  const std::vector<int64_t> values{1, 2, 3};
+  const std::string name("na\"me");
+
+  // positional placeholders may repeat and go in any order
+  const auto positional = json::prepare({{"name", json::placeholder(1)},
+                                         {"obj", {{"some", "other"}, {"int", 0}}},
+                                         {"values", json::array({json::placeholder(0), 4, json::placeholder(0)})},
+                                         {"tail", json::placeholder(2)}});
+  EXPECT_EQ(positional.arguments(), 3u);
+  EXPECT_EQ(positional.static_text(), R"%({"name":,"obj":{"some":"other","int":0},"values":[,4,],"tail":})%");
+  EXPECT_EQ(positional.build(json::numbers(values), name, nullptr),
+            json::build({{"name", name},
+                         {"obj", {{"some", "other"}, {"int", 0}}},
+                         {"values", json::array({json::array(values), 4, json::array(values)})},
+                         {"tail", nullptr}}));
+  std::string output("previous");
+  positional.build_into(output, 1, 2.5, json::builder::value_holder{{"a", "b"}});
+  EXPECT_EQ(output, R"%({"name":2.5,"obj":{"some":"other","int":0},"values":[1,4,1],"tail":{"a":"b"}})%");
+  EXPECT_THROW(positional.build(1, 2), std::runtime_error);
+  EXPECT_THROW(positional.build_named({{"name", 1}}), std::runtime_error);
+
+  // named placeholders, copy of the template is independent from the source value
+  json::prepared named;
+  {
+    const std::string field_name("dynamic");
+    named = json::prepare(json::array({json::placeholder("id"), {{field_name, json::placeholder("name")}}}));
+  }
+  EXPECT_EQ(named.arguments(), 2u);
+  EXPECT_EQ(named.build_named({{"name", name}, {"id", 7}}), R"%([7,{"dynamic":"na\"me"}])%");
+  EXPECT_EQ(named.build(7, "x"), R"%([7,{"dynamic":"x"}])%");
+  EXPECT_THROW(named.build_named({{"id", 7}}), std::runtime_error);
+
+  // template without placeholders and a single placeholder
+  EXPECT_EQ(json::prepare(json::array({1, "a"})).build(), R"%([1,"a"])%");
+  EXPECT_EQ(json::prepare(json::placeholder("all")).build_named({{"all", json::array({true})}}), "[true]");
+
+  // mixed placeholders and placeholders outside of prepare
+  EXPECT_THROW(json::prepare(json::array({json::placeholder(0), json::placeholder("a")})), std::runtime_error);
+  EXPECT_THROW(json::build(json::array({json::placeholder(0)})), std::runtime_error);
+  EXPECT_THROW(json::measure(json::array({json::placeholder(0)})), std::runtime_error);
+  EXPECT_THROW(json::build_document(json::array({json::placeholder(0)})), std::runtime_error);
+
+  // shared by threads
+  std::vector<std::thread> threads;
+  std::vector<std::string> results(4);
+  for (size_t index = 0; index < results.size(); ++index) {
+    threads.emplace_back([&, index] {
+      for (int count = 0; count < 1000; ++count) {
+        positional.build_into(results[index], index, "name", false);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t index = 0; index < results.size(); ++index) {
+    EXPECT_EQ(results[index], positional.build(index, "name", false));
+  }
+}
+
+TEST(BasicTests, BuildWithContext) {
+  const std::vector<int64_t> values{1, 2, 3};
+  json::build_context context;
+  EXPECT_EQ(context.build({{"a", json::array(values)}}), R"%({"a":[1,2,3]})%");
+  EXPECT_EQ(context.build(json::array({"b"})), R"%(["b"])%");
+
+  std::string output("previous");
+  context.build_into(output, {{"c", 1}});
+  EXPECT_EQ(output, R"%({"c":1})%");
+  context.build_append(output, json::array({}));
+  EXPECT_EQ(output, R"%({"c":1}[])%");
+
+  // context is usable after the failed build
+  EXPECT_THROW(context.build({{"d", {{nullptr, 1}}}}), std::runtime_error);
+  EXPECT_FALSE(context.busy());
+  EXPECT_EQ(context.build({{"e", true}}), R"%({"e":true})%");
+
+  // nested builds from generators while the thread context is busy
+  const auto nested = json::generate(2, [&](size_t index) { return json::build(json::array({index})); });
+  EXPECT_EQ(json::build({{"nested", nested}}), R"%({"nested":["[0]","[1]"]})%");
+  EXPECT_EQ(context.build({{"nested", nested}}), R"%({"nested":["[0]","[1]"]})%");
+
+  // same output with and without thread context
+  json::build_options options;
+  options.thread_context = false;
+  const std::string long_string(2 * json::build_context::thread_capacity, 'x');
+  EXPECT_EQ(json::build(json::array({long_string}), options), json::build(json::array({long_string})));
+
+  // result is reserved for the size of the previous build, builds of the same size allocate once
+  const std::vector<int64_t> numbers(1000, 12345);
+  const json::builder::value_holder message = json::array(numbers);
+  const std::string first = json::build(message);
+  EXPECT_EQ(json::build_context::for_thread().size_hint(), first.size());
+  const uint64_t before = allocations_count.load();
+  const std::string second = json::build(message);
+  EXPECT_EQ(allocations_count.load() - before, 1u);
+  EXPECT_EQ(second, first);
+
+  // every thread has own context
+  std::vector<std::thread> threads;
+  std::vector<std::string> results(4);
+  for (size_t index = 0; index < results.size(); ++index) {
+    threads.emplace_back([&, index] {
+      for (size_t count = 0; count < 1000; ++count) {
+        results[index] = json::build({{"thread", index}, {"count", count}});
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t index = 0; index < results.size(); ++index) {
+    EXPECT_EQ(results[index], json::build({{"thread", index}, {"count", 999}}));
+  }
+}
+
+TEST(BasicTests, BuildIntoExistingDocument) {
+  const std::vector<int64_t> values{1, 2, 3, 4, 5};
+  const std::vector<std::string> names{"a", "b"};
+
+  // document over the user buffer is reused for every build
+  char buffer[16 * 1024];
+  rapidjson::MemoryPoolAllocator<> allocator(buffer, sizeof(buffer));
+  rapidjson::Document document(&allocator);
+  for (int64_t index = 0; index < 3; ++index) {
+    json::build_document(document,
+                         {{"index", index},
+                          {"values", json::array(values)},
+                          {"numbers", json::numbers(values)},
+                          {"names", json::range(names, [](const std::string& name) { return name + "!"; })}});
+    EXPECT_EQ(json::stringify(document),
+              R"%({"index":)%" + std::to_string(index) +
+                  R"%(,"values":[1,2,3,4,5],"numbers":[1,2,3,4,5],"names":["a!","b!"]})%");
+    // containers are allocated with the exact size
+    EXPECT_EQ(document["values"].Capacity(), values.size());
+    EXPECT_EQ(document["numbers"].Capacity(), values.size());
+    EXPECT_LE(allocator.Size(), sizeof(buffer));
+  }
+
+  // document is valid after the failed build
+  EXPECT_THROW(json::build_document(document, {{"a", json::placeholder(0)}}), std::runtime_error);
+  json::build_document(document, json::array({1}));
+  EXPECT_EQ(json::stringify(document), "[1]");
+
+  // value built with the document allocator
+  rapidjson::Document target(rapidjson::kObjectType);
+  auto built = json::build_value({{"values", json::array(values)}}, target.GetAllocator());
+  target.AddMember("built", built, target.GetAllocator());
+  EXPECT_EQ(json::stringify(target), R"%({"built":{"values":[1,2,3,4,5]}})%");
+}
+
+// SAX handler that counts the events and stops after limit of them
+struct EventCounter : rapidjson::BaseReaderHandler<rapidjson::UTF8<>, EventCounter> {
+  explicit EventCounter(const size_t event_limit) : limit(event_limit) {}
+  bool Default() { return ++events < limit; }
+
+  size_t events{0};
+  const size_t limit;
+};
+
+TEST(BasicTests, EmitToSaxHandlers) {
+  const std::vector<int> numbers{1, 2, 3};
+  const std::vector<std::string> strings{"a", "b"};
+  const auto expected = json::build({{"name", "value"},
+                                     {"numbers", json::numbers(numbers)},
+                                     {"list", json::array({1, -2, true, nullptr, 0.5, json::fixed(1.5, 2)})},
+                                     {"lazy", json::range(strings)},
+                                     {"empty", {}}});
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  EXPECT_TRUE(json::emit({{"name", "value"},
+                          {"numbers", json::numbers(numbers)},
+                          {"list", json::array({1, -2, true, nullptr, 0.5, json::fixed(1.5, 2)})},
+                          {"lazy", json::range(strings)},
+                          {"empty", {}}},
+                         writer));
+  // formatted floats are numbers for the handler
+  EXPECT_EQ(std::string(buffer.GetString()), R"%({"name":"value","numbers":[1,2,3],"list":[1,-2,true,null,0.5,1.5],"lazy":["a","b"],"empty":{}})%");
+  EXPECT_EQ(expected, R"%({"name":"value","numbers":[1,2,3],"list":[1,-2,true,null,0.5,1.50],"lazy":["a","b"],"empty":{}})%");
+
+  rapidjson::StringBuffer pretty_buffer;
+  rapidjson::PrettyWriter<rapidjson::StringBuffer> pretty_writer(pretty_buffer);
+  EXPECT_TRUE(json::emit({{"a", json::array({1, 2})}}, pretty_writer));
+  EXPECT_EQ(std::string(pretty_buffer.GetString()), "{\n    \"a\": [\n        1,\n        2\n    ]\n}");
+
+  // handler stops the walk
+  EventCounter counter(3);
+  EXPECT_FALSE(json::emit(json::array({1, 2, 3, 4, 5}), counter));
+  EXPECT_EQ(counter.events, 3u);
+  // lazy array stops pulling its elements, number array stops in the middle
+  size_t calls = 0;
+  EventCounter lazy_counter(4);
+  EXPECT_FALSE(json::emit(json::array({json::generate(100, [&](const size_t index) {
+                                         ++calls;
+                                         return static_cast<int>(index);
+                                       })}),
+                          lazy_counter));
+  EXPECT_EQ(lazy_counter.events, 4u);
+  EXPECT_EQ(calls, 2u);
+  EventCounter numbers_counter(4);
+  EXPECT_FALSE(json::emit({{"numbers", json::numbers(numbers)}, {"name", "value"}}, numbers_counter));
+  EXPECT_EQ(numbers_counter.events, 4u);
+  EventCounter all(100);
+  EXPECT_TRUE(json::emit({{"a", json::array({1, 2})}, {"b", "text"}}, all));
+  // object, key, array, 2 values, array end, key, string, object end
+  EXPECT_EQ(all.events, 9u);
+
+  EXPECT_THROW(json::emit(json::array({json::placeholder(0)}), all), std::runtime_error);
+  EXPECT_THROW(json::emit(json::array({json::array({1})}), all, 1), std::runtime_error);
+}
+
+TEST(BasicTests, RawFragments) {
+  const std::string cached(R"%({"a":[1,-2,0.5],"b":"text"})%");
+  const std::string expected(R"%({"id":1,"cached":{"a":[1,-2,0.5],"b":"text"},"list":[true,2]})%");
+  EXPECT_EQ(json::build({{"id", 1}, {"cached", json::raw(cached)}, {"list", json::array({json::raw("true"), 2})}}),
+            expected);
+  EXPECT_EQ(json::measure({{"id", 1}, {"cached", json::raw(cached)}, {"list", json::array({json::raw("true"), 2})}}),
+            expected.size());
+  // text goes as is, whitespaces are kept
+  EXPECT_EQ(json::build(json::array({json::raw(" [ 1 ] ")})), "[ [ 1 ] ]");
+
+  // documents parse the text, strings are copies in the document allocator
+  rapidjson::Document document;
+  {
+    std::string text(cached);
+    document = json::build_document({{"cached", json::raw(text)}, {"flag", json::raw("false")}});
+    text.assign(text.size(), ' ');
+  }
+  EXPECT_EQ(json::stringify(document), R"%({"cached":{"a":[1,-2,0.5],"b":"text"},"flag":false})%");
+  EXPECT_TRUE(document["cached"]["a"][0u].IsInt());
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  EXPECT_TRUE(json::emit({{"cached", json::raw(cached)}}, writer));
+  EXPECT_EQ(std::string(buffer.GetString()), R"%({"cached":{"a":[1,-2,0.5],"b":"text"}})%");
+  EventCounter counter(4);
+  EXPECT_FALSE(json::emit({{"cached", json::raw(cached)}}, counter));
+  EXPECT_EQ(counter.events, 4u);
+
+  // text is checked only when it is parsed
+  const std::string_view invalid[] = {"", "{", "[1,", "1 2", std::string_view("1\0", 2)};
+  for (const std::string_view text : invalid) {
+    EXPECT_NO_THROW(json::build(json::array({json::raw(text)})));
+    EXPECT_THROW(json::build_document(json::array({json::raw(text)})), std::runtime_error);
+  }
+}
+
+TEST(BasicTests, CachedFragments) {
+  json::fragment_cache cache(1024);
+  const auto status = [&](const uint64_t version, const int value) {
+    return json::build({{"id", 1}, {"status", json::cached(cache, "status", version, {{"value", value}})}});
+  };
+  EXPECT_EQ(status(1, 10), R"%({"id":1,"status":{"value":10}})%");
+  // same version gives the cached text even for other subtree
+  EXPECT_EQ(status(1, 20), R"%({"id":1,"status":{"value":10}})%");
+  EXPECT_EQ(status(2, 20), R"%({"id":1,"status":{"value":20}})%");
+  EXPECT_EQ(cache.hits(), 1u);
+  EXPECT_EQ(cache.misses(), 2u);
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_EQ(cache.bytes(), std::string("status").size() + std::string(R"%({"value":20})%").size());
+
+  // options are for the subtree text, documents parse it
+  json::build_options options;
+  options.floats = {json::float_mode::fixed, 2};
+  EXPECT_EQ(json::build(json::array({json::cached(cache, "floats", 1, json::array({0.5}), options)})), "[[0.50]]");
+  EXPECT_EQ(json::stringify(json::build_document({{"status", json::cached(cache, "status", 2, nullptr)}})),
+            R"%({"status":{"value":20}})%");
+
+  // key and text of 4 bytes each
+  json::fragment_cache small(12);
+  for (const char* key : {"a", "b", "c"}) {
+    json::cached(small, key, 1, json::array({1}));
+  }
+  EXPECT_EQ(small.bytes(), 12u);
+  // hit entry stays, the oldest one of others goes
+  json::cached(small, "a", 1, json::array({1}));
+  json::cached(small, "d", 1, json::array({1}));
+  EXPECT_EQ(small.size(), 3u);
+  EXPECT_EQ(small.misses(), 4u);
+  json::cached(small, "a", 1, json::array({1}));
+  json::cached(small, "c", 1, json::array({1}));
+  EXPECT_EQ(small.hits(), 3u);
+  json::cached(small, "b", 1, json::array({1}));
+  EXPECT_EQ(small.misses(), 5u);
+  // text larger than the cache is not kept
+  EXPECT_EQ(json::build(json::cached(small, "large", 1, std::string_view("large text"))), R"%("large text")%");
+  EXPECT_EQ(small.size(), 3u);
+  small.clear();
+  EXPECT_EQ(small.size(), 0u);
+  EXPECT_EQ(small.bytes(), 0u);
+
+  // readers and writers of the same keys
+  json::fragment_cache shared(64);
+  std::vector<std::thread> threads;
+  std::atomic<size_t> failures{0};
+  for (size_t thread = 0; thread < 4; ++thread) {
+    threads.emplace_back([&] {
+      for (size_t count = 0; count < 1000; ++count) {
+        const size_t key = count % 16;
+        const size_t version = count / 100;
+        const std::string text = json::build(
+            {{"key", key}, {"value", json::cached(shared, std::to_string(key), version, json::array({key, version}))}});
+        if (text != json::build({{"key", key}, {"value", json::array({key, version})}})) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(failures, 0u);
+  EXPECT_EQ(shared.hits() + shared.misses(), 4000u);
+  EXPECT_LE(shared.bytes(), 64u);
+}
+
+// reads MessagePack or CBOR and passes the values to the rapidjson SAX handler
+class BinaryReader {
+ public:
+  explicit BinaryReader(const std::string_view bytes) : bytes_(bytes) {}
+
+  bool AtEnd() const { return position_ == bytes_.size(); }
+
+  template <typename Handler>
+  void ReadMsgpack(Handler& handler) {
+    const uint8_t byte = static_cast<uint8_t>(Read(1));
+    if (byte <= 0x7f) {
+      handler.Uint64(byte);
+    } else if (byte >= 0xe0) {
+      handler.Int64(static_cast<int8_t>(byte));
+    } else if (0xa0 == (byte & 0xe0)) {
+      String(handler, byte & 0x1f, false);
+    } else if (0x90 == (byte & 0xf0)) {
+      MsgpackArray(handler, byte & 0x0f);
+    } else if (0x80 == (byte & 0xf0)) {
+      MsgpackMap(handler, byte & 0x0f);
+    } else if (0xc0 == byte) {
+      handler.Null();
+    } else if (0xc2 == byte || 0xc3 == byte) {
+      handler.Bool(0xc3 == byte);
+    } else if (byte >= 0xcc && byte <= 0xcf) {
+      handler.Uint64(Read(size_t(1) << (byte - 0xcc)));
+    } else if (0xd0 == byte) {
+      handler.Int64(static_cast<int8_t>(Read(1)));
+    } else if (0xd1 == byte) {
+      handler.Int64(static_cast<int16_t>(Read(2)));
+    } else if (0xd2 == byte) {
+      handler.Int64(static_cast<int32_t>(Read(4)));
+    } else if (0xd3 == byte) {
+      handler.Int64(static_cast<int64_t>(Read(8)));
+    } else if (0xca == byte) {
+      handler.Double(Float(Read(4)));
+    } else if (0xcb == byte) {
+      handler.Double(Double(Read(8)));
+    } else if (byte >= 0xd9 && byte <= 0xdb) {
+      String(handler, Read(size_t(1) << (byte - 0xd9)), false);
+    } else if (0xdc == byte || 0xdd == byte) {
+      MsgpackArray(handler, Read(0xdc == byte ? 2 : 4));
+    } else if (0xde == byte || 0xdf == byte) {
+      MsgpackMap(handler, Read(0xde == byte ? 2 : 4));
+    } else {
+      throw std::runtime_error("unexpected MessagePack byte");
+    }
+  }
+
+  template <typename Handler>
+  void ReadCbor(Handler& handler) {
+    const uint8_t byte = static_cast<uint8_t>(Read(1));
+    const uint8_t major = byte >> 5;
+    const uint8_t info = byte & 0x1f;
+    if (7 == major) {
+      if (0xf4 == byte || 0xf5 == byte) {
+        handler.Bool(0xf5 == byte);
+      } else if (0xf6 == byte) {
+        handler.Null();
+      } else if (0xfa == byte) {
+        handler.Double(Float(Read(4)));
+      } else if (0xfb == byte) {
+        handler.Double(Double(Read(8)));
+      } else {
+        throw std::runtime_error("unexpected CBOR simple value");
+      }
+      return;
+    }
+    if (info > 27) {
+      throw std::runtime_error("unexpected CBOR length");
+    }
+    const uint64_t argument = info < 24 ? info : Read(size_t(1) << (info - 24));
+    if (0 == major) {
+      handler.Uint64(argument);
+    } else if (1 == major) {
+      handler.Int64(-1 - static_cast<int64_t>(argument));
+    } else if (3 == major) {
+      String(handler, argument, false);
+    } else if (4 == major) {
+      handler.StartArray();
+      for (uint64_t index = 0; index < argument; ++index) {
+        ReadCbor(handler);
+      }
+      handler.EndArray(static_cast<rapidjson::SizeType>(argument));
+    } else if (5 == major) {
+      handler.StartObject();
+      for (uint64_t index = 0; index < argument; ++index) {
+        const uint8_t key = static_cast<uint8_t>(Read(1));
+        if (3 != key >> 5 || (key & 0x1f) > 27) {
+          throw std::runtime_error("CBOR key is not a string");
+        }
+        String(handler, (key & 0x1f) < 24 ? key & 0x1f : Read(size_t(1) << ((key & 0x1f) - 24)), true);
+        ReadCbor(handler);
+      }
+      handler.EndObject(static_cast<rapidjson::SizeType>(argument));
+    } else {
+      throw std::runtime_error("unexpected CBOR major type");
+    }
+  }
+
+ private:
+  uint64_t Read(const size_t size) {
+    if (bytes_.size() - position_ < size) {
+      throw std::runtime_error("binary value is truncated");
+    }
+    uint64_t value = 0;
+    for (size_t index = 0; index < size; ++index) {
+      value = value << 8 | static_cast<uint8_t>(bytes_[position_++]);
+    }
+    return value;
+  }
+  static double Float(const uint64_t bits) {
+    const auto bits32 = static_cast<uint32_t>(bits);
+    float value;
+    std::memcpy(&value, &bits32, sizeof(value));
+    return value;
+  }
+  static double Double(const uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  template <typename Handler>
+  void String(Handler& handler, const uint64_t size, const bool key) {
+    if (bytes_.size() - position_ < size) {
+      throw std::runtime_error("binary string is truncated");
+    }
+    const char* data = bytes_.data() + position_;
+    position_ += static_cast<size_t>(size);
+    if (key) {
+      handler.Key(data, static_cast<rapidjson::SizeType>(size), true);
+    } else {
+      handler.String(data, static_cast<rapidjson::SizeType>(size), true);
+    }
+  }
+  template <typename Handler>
+  void MsgpackArray(Handler& handler, const uint64_t size) {
+    handler.StartArray();
+    for (uint64_t index = 0; index < size; ++index) {
+      ReadMsgpack(handler);
+    }
+    handler.EndArray(static_cast<rapidjson::SizeType>(size));
+  }
+  template <typename Handler>
+  void MsgpackMap(Handler& handler, const uint64_t size) {
+    handler.StartObject();
+    for (uint64_t index = 0; index < size; ++index) {
+      const uint8_t key = static_cast<uint8_t>(Read(1));
+      if (0xa0 == (key & 0xe0)) {
+        String(handler, key & 0x1f, true);
+      } else if (key >= 0xd9 && key <= 0xdb) {
+        String(handler, Read(size_t(1) << (key - 0xd9)), true);
+      } else {
+        throw std::runtime_error("MessagePack key is not a string");
+      }
+      ReadMsgpack(handler);
+    }
+    handler.EndObject(static_cast<rapidjson::SizeType>(size));
+  }
+
+  std::string_view bytes_;
+  size_t position_{0};
+};
+
+// json text of the MessagePack or CBOR bytes
+std::string BinaryToJson(const std::string& bytes, const bool cbor) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  BinaryReader reader(bytes);
+  if (cbor) {
+    reader.ReadCbor(writer);
+  } else {
+    reader.ReadMsgpack(writer);
+  }
+  EXPECT_TRUE(reader.AtEnd());
+  return buffer.GetString();
+}
+
+// both encodings decode to the json text of the value
+void ExpectBinaryRoundTrip(const json::builder::value_holder& value) {
+  const std::string expected = json::build(value);
+  EXPECT_EQ(BinaryToJson(json::build_msgpack(value), false), expected);
+  EXPECT_EQ(BinaryToJson(json::build_cbor(value), true), expected);
+
+  // into replaces the content
+  std::string output(1000, 'x');
+  json::build_msgpack_into(output, value);
+  EXPECT_EQ(output, json::build_msgpack(value));
+  json::build_cbor_into(output, value);
+  EXPECT_EQ(output, json::build_cbor(value));
+}
+
+TEST(BasicTests, BinaryRoundTrip) {
+  const std::vector<int16_t> shorts{-300, -1, 0, 200};
+  const std::vector<uint64_t> large{0, UINT32_MAX, uint64_t(UINT32_MAX) + 1, UINT64_MAX};
+  const std::vector<std::string> names{"first", "second"};
+  const std::string long_string(300, 's');
+  ExpectBinaryRoundTrip(
+      {{"uints", json::array({0, 127, 128, 255, 256, 65535, 65536, uint64_t(UINT32_MAX) + 1})},
+       {"ints", json::array({-1, -32, -33, -128, -129, -32768, -32769, int64_t(INT32_MIN) - 1, INT64_MIN})},
+       {"doubles", json::array({0.5, 0.1, -1e300, 3.0})},
+       {"flags", json::array({true, false, nullptr})},
+       {"shorts", json::numbers(shorts)},
+       {"large", json::numbers(large)},
+       {"names", json::range(names)},
+       {"generated", json::generate(20, [](const size_t index) { return index * 1000; })},
+       {"long", long_string},
+       {"raw", json::raw(R"%({"a":[1,-2,0.25,"x"],"b":{}})%")},
+       {"empty", {}},
+       {"nested", json::array({json::array(std::vector<int>()), json::array({1, json::array({"deep"})})})}});
+  ExpectBinaryRoundTrip(json::generate(70000, [](const size_t index) { return index % 2 == 0; }));
+}
+
+TEST(BasicTests, BinaryShortestForms) {
+  const auto bytes = [](std::initializer_list<int> values) {
+    std::string result;
+    for (const int value : values) {
+      result.push_back(static_cast<char>(value));
+    }
+    return result;
+  };
+  EXPECT_EQ(json::build_msgpack(json::array({0, 127, 128, -1, -32, -33, 256, true, nullptr, "ab"})),
+            bytes({0x9a, 0x00, 0x7f, 0xcc, 0x80, 0xff, 0xe0, 0xd0, 0xdf, 0xcd, 0x01, 0x00, 0xc3, 0xc0, 0xa2, 'a', 'b'}));
+  EXPECT_EQ(json::build_cbor(json::array({0, 127, 128, -1, -32, -33, 256, true, nullptr, "ab"})),
+            bytes({0x8a, 0x00, 0x18, 0x7f, 0x18, 0x80, 0x20, 0x38, 0x1f, 0x38, 0x20, 0x19, 0x01, 0x00, 0xf5, 0xf6, 0x62,
+                   'a', 'b'}));
+  EXPECT_EQ(json::build_msgpack({{"a", 65536}}), bytes({0x81, 0xa1, 'a', 0xce, 0x00, 0x01, 0x00, 0x00}));
+  EXPECT_EQ(json::build_cbor({{"a", 65536}}), bytes({0xa1, 0x61, 'a', 0x1a, 0x00, 0x01, 0x00, 0x00}));
+
+  // MessagePack keeps the double type, CBOR takes float 32 when the value is the same
+  EXPECT_EQ(json::build_msgpack(json::array({0.5})), bytes({0x91, 0xcb, 0x3f, 0xe0, 0, 0, 0, 0, 0, 0}));
+  EXPECT_EQ(json::build_cbor(json::array({0.5})), bytes({0x81, 0xfa, 0x3f, 0x00, 0x00, 0x00}));
+  EXPECT_EQ(json::build_cbor(json::array({0.1})).size(), 10u);
+  EXPECT_EQ(json::build_msgpack(json::array({json::shortest(0.1f)})), bytes({0x91, 0xca, 0x3d, 0xcc, 0xcc, 0xcd}));
+
+  // lazy arrays get the count when they end
+  const auto generated = json::generate(20, [](const size_t index) { return index; });
+  EXPECT_EQ(json::build_msgpack(generated).substr(0, 4), bytes({0xdc, 0x00, 0x14, 0x00}));
+  EXPECT_EQ(json::build_cbor(generated).substr(0, 3), bytes({0x94, 0x00, 0x01}));
+  EXPECT_EQ(json::build_msgpack(json::raw("[[],{}]")), bytes({0x92, 0x90, 0x80}));
+
+  EXPECT_THROW(json::build_msgpack(json::array({json::placeholder(0)})), std::runtime_error);
+  EXPECT_THROW(json::build_cbor(json::array({json::array({1})}), 1), std::runtime_error);
+  EXPECT_THROW(json::build_cbor(json::raw("[1,")), std::runtime_error);
+}
+
+struct Position {
+  double lat;
+  double lon;
+};
+
+struct Order {
+  int64_t id;
+  std::string name;
+  double price;
+  bool active;
+  std::vector<int> quantities;
+  std::vector<std::string> tags;
+  Position position;
+  std::vector<Position> route;
+  const char* note;
+};
+
+}  // namespace
+
+template <>
+struct json::describe<Position> {
+  static constexpr auto fields =
+      std::make_tuple(json::member("lat", &Position::lat), json::member("lon", &Position::lon));
+};
+
+template <>
+struct json::describe<Order> {
+  static constexpr auto fields = std::make_tuple(
+      json::member("id", &Order::id), json::member("name", &Order::name), json::member("price", &Order::price),
+      json::member("active", &Order::active), json::member("quantities", &Order::quantities),
+      json::member("tags", &Order::tags), json::member("position", &Order::position),
+      json::member("route", &Order::route), json::member("note \"\t", &Order::note));
+};
+
+namespace {
+
+TEST(BasicTests, DescribedStructs) {
+  static_assert(json::member("a\"b\n", &Order::id).key() == "\"a\\\"b\\n\":");
+
+  const std::vector<Order> orders{
+      {1, "first", 10.5, true, {1, 2, 3}, {"new", "paid"}, {55.75, 37.5}, {{1, 2}, {3, 4}}, "fragile"},
+      {2, "second", 0.25, false, {}, {}, {0, 0}, {}, ""}};
+  const std::string expected[] = {
+      R"%({"id":1,"name":"first","price":10.5,"active":true,"quantities":[1,2,3],"tags":["new","paid"],)%"
+      R"%("position":{"lat":55.75,"lon":37.5},"route":[{"lat":1.0,"lon":2.0},{"lat":3.0,"lon":4.0}],)%"
+      R"%("note \"\t":"fragile"})%",
+      R"%({"id":2,"name":"second","price":0.25,"active":false,"quantities":[],"tags":[],)%"
+      R"%("position":{"lat":0.0,"lon":0.0},"route":[],"note \"\t":""})%"};
+  for (size_t index = 0; index < orders.size(); ++index) {
+    const Order& order = orders[index];
+    EXPECT_EQ(json::build(json::object(order)), expected[index]);
+    EXPECT_EQ(json::measure(json::object(order)), expected[index].size());
+    EXPECT_EQ(json::build_msgpack(json::object(order)), json::build_msgpack(json::raw(expected[index])));
+    // same as the object from the initializer lists
+    EXPECT_EQ(json::build(json::object(order)),
+              json::build({{"id", order.id},
+                           {"name", order.name},
+                           {"price", order.price},
+                           {"active", order.active},
+                           {"quantities", json::numbers(order.quantities)},
+                           {"tags", json::range(order.tags)},
+                           {"position", {{"lat", order.position.lat}, {"lon", order.position.lon}}},
+                           {"route", json::raw(json::build(json::array(order.route)))},
+                           {"note \"\t", order.note}}));
+  }
+
+  const std::string text = json::build({{"orders", json::array(orders)}, {"count", orders.size()}});
+  EXPECT_EQ(text, json::build({{"orders", json::array({json::raw(json::build(json::object(orders[0]))),
+                                                       json::raw(json::build(json::object(orders[1])))})},
+                               {"count", orders.size()}}));
+  EXPECT_EQ(json::measure({{"orders", json::array(orders)}}), json::build({{"orders", json::array(orders)}}).size());
+  const std::vector<Order> empty;
+  EXPECT_EQ(json::build(json::array(empty)), "[]");
+
+  // document gets the same tree, strings are copied from the structs
+  rapidjson::Document document;
+  json::build_document(document, json::array(orders));
+  ASSERT_TRUE(document.IsArray());
+  ASSERT_EQ(document.Size(), 2u);
+  EXPECT_EQ(std::string(document[0]["name"].GetString()), "first");
+  EXPECT_EQ(document[0]["route"][1]["lon"].GetDouble(), 4.0);
+  EXPECT_EQ(document[1]["tags"].Size(), 0u);
+
+  // array, order, route and position
+  json::build_options options;
+  options.max_depth = 4;
+  EXPECT_EQ(json::build(json::array(orders), options), json::build(json::array(orders)));
+  options.max_depth = 3;
+  EXPECT_THROW(json::build(json::array(orders), options), std::runtime_error);
+}
+
+TEST(BasicTests, ObjectsFromContainers) {
+  const std::map<std::string, int> counters{{"b", 2}, {"a", 1}, {"c\"", 3}};
+  EXPECT_EQ(json::build(json::object(counters)), R"%({"a":1,"b":2,"c\"":3})%");
+  EXPECT_EQ(json::measure(json::object(counters)), json::build(json::object(counters)).size());
+
+  // pairs keep the order unless sorted, equal keys keep the order when sorted
+  const std::vector<std::pair<std::string, std::string>> pairs{{"z", "last"}, {"x", "first"}, {"z", "again"}};
+  EXPECT_EQ(json::build(json::object(pairs)), R"%({"z":"last","x":"first","z":"again"})%");
+  EXPECT_EQ(json::build(json::object(pairs, json::key_order::sorted)), R"%({"x":"first","z":"last","z":"again"})%");
+
+  std::unordered_map<std::string, std::vector<int>> series;
+  for (int index = 0; index < 100; ++index) {
+    series["key" + std::to_string(index)].assign(static_cast<size_t>(index % 3), index);
+  }
+  std::vector<std::string> keys;
+  for (const auto& item : series) {
+    keys.push_back(item.first);
+  }
+  std::sort(keys.begin(), keys.end());
+  std::string expected;
+  for (const std::string& key : keys) {
+    expected += (expected.empty() ? "{\"" : ",\"") + key + "\":" + json::build(json::numbers(series[key]));
+  }
+  expected += "}";
+  EXPECT_EQ(json::build(json::object(series, json::key_order::sorted)), expected);
+
+  // values are converted like the described struct fields
+  const std::map<std::string, std::map<std::string, Position>> nested{{"route", {{"start", {1, 2}}, {"end", {3, 4}}}},
+                                                                      {"empty", {}}};
+  const std::string text = R"%({"empty":{},"route":{"end":{"lat":3.0,"lon":4.0},"start":{"lat":1.0,"lon":2.0}}})%";
+  EXPECT_EQ(json::build(json::object(nested)), text);
+  EXPECT_EQ(json::build({{"nested", json::object(nested)}, {"count", nested.size()}}),
+            R"%({"nested":)%" + text + R"%(,"count":2})%");
+  EXPECT_EQ(json::build_msgpack(json::object(nested)), json::build_msgpack(json::raw(text)));
+  EXPECT_EQ(json::build_cbor(json::object(nested)), json::build_cbor(json::raw(text)));
+
+  rapidjson::Document document;
+  json::build_document(document, json::object(nested));
+  ASSERT_TRUE(document.IsObject());
+  EXPECT_EQ(document.MemberCount(), 2u);
+  EXPECT_EQ(document["route"]["start"]["lon"].GetDouble(), 2.0);
+
+  json::build_options options;
+  options.max_depth = 3;
+  EXPECT_EQ(json::build(json::object(nested), options), text);
+  options.max_depth = 2;
+  EXPECT_THROW(json::build(json::object(nested), options), std::runtime_error);
+}
+
+TEST(BasicTests, BuildDocumentWithCopiedStrings) {
+  const json::document_options copy{true};
+  rapidjson::Document document;
+  rapidjson::Document target(rapidjson::kObjectType);
+  {
+    // strings and keys are temporaries, document keeps own copies
+    const std::string key("key");
+    const std::string value(100, 'v');
+    const std::vector<std::string> names{"first", "second"};
+    document = json::build_document({{key, value},
+                                     {"names", json::array(names)},
+                                     {"lazy", json::range(names, [](const std::string& name) { return name + "!"; })},
+                                     {"empty", ""}},
+                                    copy);
+    EXPECT_NE(document["key"].GetString(), value.data());
+    EXPECT_NE(document["names"][0u].GetString(), names[0].data());
+
+    auto built = json::build_value(json::array({value, key}), target.GetAllocator(), copy);
+    target.AddMember("built", built, target.GetAllocator());
+  }
+  EXPECT_EQ(json::stringify(document),
+            R"%({"key":")%" + std::string(100, 'v') +
+                R"%(","names":["first","second"],"lazy":["first!","second!"],"empty":""})%");
+  EXPECT_EQ(json::stringify(target), R"%({"built":[")%" + std::string(100, 'v') + R"%(","key"]})%");
+
+  // reused document copies strings as well
+  {
+    const std::string value("reused");
+    json::build_document(document, {{value, value}}, copy);
+  }
+  EXPECT_EQ(json::stringify(document), R"%({"reused":"reused"})%");
+}
+
+// [[...[1]...]] from the vectors, nesting of any depth can be built this way
+json::builder::value_holder MakeNestedArrays(const size_t depth) {
+  std::optional<json::builder::array_holder> nested(std::in_place);
+  nested->emplace_back(1);
+  for (size_t level = 1; level < depth; ++level) {
+    json::builder::array_holder parent;
+    parent.emplace_back(std::move(*nested));
+    nested.emplace(std::move(parent));
+  }
+  return json::builder::value_holder(std::move(*nested));
+}
+
+TEST(BasicTests, BuildDeepNesting) {
+  constexpr size_t kDepth = 10000;
+  const json::builder::value_holder value = MakeNestedArrays(kDepth);
+  const std::string expected = std::string(kDepth, '[') + "1" + std::string(kDepth, ']');
+  EXPECT_EQ(json::build(value), expected);
+  EXPECT_EQ(json::measure(value), expected.size());
+  // stringify is recursive, document is checked level by level
+  const auto check_document = [&](const rapidjson::Value& document) {
+    const rapidjson::Value* level = &document;
+    for (size_t index = 0; index < kDepth; ++index) {
+      ASSERT_TRUE(level->IsArray());
+      ASSERT_EQ(level->Size(), 1u);
+      level = &(*level)[0u];
+    }
+    EXPECT_EQ(level->GetInt(), 1);
+  };
+  check_document(json::build_document(value));
+  json::build_options options;
+  options.exact_size = true;
+  EXPECT_EQ(json::build(value, options), expected);
+
+  // nesting up to max_depth is fine
+  options.max_depth = kDepth;
+  EXPECT_EQ(json::build(value, options), expected);
+  json::document_options document_options;
+  document_options.max_depth = kDepth;
+  document_options.copy_strings = true;
+  check_document(json::build_document(value, document_options));
+
+  // one level deeper fails
+  options.max_depth = kDepth - 1;
+  EXPECT_THROW(json::build(value, options), std::runtime_error);
+  document_options.max_depth = kDepth - 1;
+  EXPECT_THROW(json::build_document(value, document_options), std::runtime_error);
+  json::build_context context;
+  EXPECT_THROW(context.build(value, options), std::runtime_error);
+  EXPECT_FALSE(context.busy());
+
+  // empty containers and lazy arrays count too
+  json::build_options shallow;
+  shallow.max_depth = 2;
+  const auto empty_arrays = json::generate(1, [](size_t) { return json::array({}); });
+  EXPECT_EQ(json::build({{"a", json::array({})}}, shallow), R"%({"a":[]})%");
+  EXPECT_EQ(json::build(empty_arrays, shallow), "[[]]");
+  EXPECT_THROW(json::build({{"a", {{"b", json::array({})}}}}, shallow), std::runtime_error);
+  EXPECT_THROW(json::build(json::array({empty_arrays}), shallow), std::runtime_error);
+  EXPECT_THROW(json::build(json::generate(1, [](size_t) { return MakeNestedArrays(2); }), shallow), std::runtime_error);
+}
+
+TEST(BasicTests, ParallelBuildMatchesSerial) {
+  std::vector<json::builder::value_holder> values;
+  for (int64_t index = 0; index < 10000; ++index) {
+    switch (index % 4) {
+      case 0:
+        values.emplace_back(json::array(std::vector<int64_t>{index, -index}));
+        break;
+      case 1:
+        values.emplace_back("escaped \"text\"\n");
+        break;
+      case 2:
+        values.emplace_back(static_cast<double>(index) / 3);
+        break;
+      default:
+        values.emplace_back(MakeNestedArrays(3));
+    }
+  }
+  json::build_options parallel;
+  parallel.parallel_threshold = 100;
+  const auto build = [&](const json::build_options& options) {
+    return json::build({{"meta", {{"count", values.size()}, {"nested", json::array({json::array(values), 1})}}},
+                        {"values", json::array(values)},
+                        {"small", json::array({1, 2})}},
+                       options);
+  };
+  const std::string expected = build({});
+  for (const size_t threads : {2, 3, 8, 16}) {
+    parallel.parallel_threads = threads;
+    EXPECT_EQ(build(parallel), expected);
+  }
+  EXPECT_EQ(json::build(json::array(values), parallel), json::build(json::array(values)));
+  json::build_options exact = parallel;
+  exact.exact_size = true;
+  EXPECT_EQ(build(exact), expected);
+
+  // short arrays and the ones below the threshold are the same too
+  parallel.parallel_threshold = 1;
+  EXPECT_EQ(json::build(json::array({1, 2, 3}), parallel), "[1,2,3]");
+  EXPECT_EQ(json::build(json::array({}), parallel), "[]");
+
+  // errors of the workers reach the caller
+  parallel.max_depth = 7;
+  EXPECT_EQ(build(parallel), expected);
+  parallel.max_depth = 6;
+  EXPECT_THROW(build(parallel), std::runtime_error);
+  parallel.max_depth = 0;
+  EXPECT_THROW(json::build(json::array({1, json::placeholder(0)}), parallel), std::runtime_error);
+
+  // nested lazy arrays are enumerated by the calling thread only, stateful generators are fine
+  const std::thread::id caller = std::this_thread::get_id();
+  size_t calls = 0;
+  bool other_thread = false;
+  const auto counter = json::generate(2, [&](const size_t index) {
+    other_thread = other_thread || std::this_thread::get_id() != caller;
+    return ++calls + index;
+  });
+  std::vector<json::builder::value_holder> rows;
+  for (size_t index = 0; index < 1000; ++index) {
+    if (500 == index) {
+      rows.emplace_back(json::array(std::vector<json::builder::value_holder>{0, counter}));
+    } else {
+      rows.emplace_back(values[index]);
+    }
+  }
+  parallel.parallel_threads = 8;
+  const std::string text = json::build(json::array(rows), parallel);
+  EXPECT_EQ(calls, 2u);
+  EXPECT_NE(text.find(",[0,[1,3]],"), std::string::npos);
+  EXPECT_FALSE(other_thread);
+}
+
+template <typename T, typename = void>
+struct accepts_build_many : std::false_type {};
+
+template <typename T>
+struct accepts_build_many<T, std::void_t<decltype(json::build_many(std::declval<const T&>()))>> : std::true_type {};
+
+template <typename T, typename = void>
+struct accepts_build_many_pointer : std::false_type {};
+
+template <typename T>
+struct accepts_build_many_pointer<T, std::void_t<decltype(json::build_many(std::declval<const T*>(), 1))>>
+    : std::true_type {};
+
+TEST(BasicTests, BuildManyMatchesBuild) {
+  // arrays of the derived holders have another stride, they are not arrays of values
+  static_assert(accepts_build_many<std::vector<json::builder::value_holder>>::value);
+  static_assert(accepts_build_many<std::array<json::builder::value_holder, 2>>::value);
+  static_assert(!accepts_build_many<std::vector<json::builder::array_holder>>::value);
+  static_assert(!accepts_build_many<std::vector<json::builder::cached_holder>>::value);
+  static_assert(accepts_build_many_pointer<json::builder::value_holder>::value);
+  static_assert(!accepts_build_many_pointer<json::builder::array_holder>::value);
+
+
+  std::vector<json::builder::value_holder> messages;
+  for (int64_t index = 0; index < 1000; ++index) {
+    messages.emplace_back(json::array(std::vector<json::builder::value_holder>{"event", index, 0 == index % 2}));
+  }
+  std::string expected_lines;
+  for (const auto& message : messages) {
+    expected_lines += json::build(message) + "\n";
+  }
+  for (const size_t threads : {0, 1, 4}) {
+    const json::build_batch batch = json::build_many(messages, {}, threads);
+    ASSERT_EQ(batch.size(), messages.size());
+    for (size_t index = 0; index < messages.size(); ++index) {
+      EXPECT_EQ(batch[index], json::build(messages[index]));
+    }
+    std::string lines("header\n");
+    json::build_many_lines(lines, messages, {}, threads);
+    EXPECT_EQ(lines, "header\n" + expected_lines);
+  }
+
+  // batch is reused
+  json::build_batch batch;
+  json::build_many_into(batch, messages.data(), 2);
+  json::build_many_into(batch, messages.data() + 1, 1);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0], R"%(["event",1,false])%");
+  EXPECT_EQ(json::build_many(messages.data(), 0).size(), 0u);
+
+  // messages with lazy arrays are built by the calling thread only, stateful generators are fine
+  const std::thread::id caller = std::this_thread::get_id();
+  size_t calls = 0;
+  bool other_thread = false;
+  const auto counter = json::generate(2, [&](const size_t index) {
+    other_thread = other_thread || std::this_thread::get_id() != caller;
+    return ++calls + index;
+  });
+  std::vector<json::builder::value_holder> lazy_messages;
+  for (size_t index = 0; index < messages.size(); ++index) {
+    if (500 == index) {
+      lazy_messages.emplace_back(json::array(std::vector<json::builder::value_holder>{0, counter}));
+    } else {
+      lazy_messages.emplace_back(messages[index]);
+    }
+  }
+  const json::build_batch lazy_batch = json::build_many(lazy_messages, {}, 8);
+  ASSERT_EQ(lazy_batch.size(), lazy_messages.size());
+  EXPECT_EQ(lazy_batch[499], json::build(messages[499]));
+  EXPECT_EQ(lazy_batch[500], "[0,[1,3]]");
+  EXPECT_EQ(lazy_batch[501], json::build(messages[501]));
+  EXPECT_EQ(calls, 2u);
+  EXPECT_FALSE(other_thread);
+
+  // errors of the workers reach the caller
+  messages.emplace_back(json::placeholder(0));
+  EXPECT_THROW(json::build_many(messages), std::runtime_error);
+}
+
+TEST(StreamingTests, BuildToCallbackInBoundedChunks) {
+  std::vector<int64_t> values(10000);
+  for (size_t index = 0; index < values.size(); ++index) {
+    values[index] = static_cast<int64_t>(index) * 1000;
+  }
+  const auto expected = json::build({{"name", "value"}, {"values", json::array(values)}});
+
+  std::string streamed;
+  size_t chunks = 0;
+  json::build_to(
+      [&](std::string_view chunk) {
+        EXPECT_FALSE(chunk.empty());
+        EXPECT_LE(chunk.size(), 1024u);
+        streamed.append(chunk);
+        ++chunks;
+      },
+      {{"name", "value"}, {"values", json::array(values)}},
+      1024);
+  EXPECT_EQ(streamed, expected);
+  EXPECT_EQ(chunks, (expected.size() + 1023) / 1024);
+
+  // long escaped string is split between chunks as well
+  const std::string long_string(5000, '\n');
+  streamed.clear();
+  json::build_to([&](std::string_view chunk) { streamed.append(chunk); }, json::array({long_string}), 100);
+  EXPECT_EQ(streamed, json::build(json::array({long_string})));
+
+  EXPECT_THROW(json::build_to([](std::string_view) {}, json::array({}), 0), std::runtime_error);
+}
+
+TEST(StreamingTests, BuildToStreamAndFile) {
+  std::vector<std::string> values(1000, "value");
+  const auto expected = json::build({{"strings", json::array(values)}, {"int", 1}});
+
+  std::ostringstream stream;
+  json::build_to(stream, {{"strings", json::array(values)}, {"int", 1}}, 256);
+  EXPECT_EQ(stream.str(), expected);
+
+  std::FILE* file = std::tmpfile();
+  ASSERT_NE(file, nullptr);
+  json::build_to(file, {{"strings", json::array(values)}, {"int", 1}}, 256);
+  std::fflush(file);
+  std::rewind(file);
+  std::string from_file(expected.size() + 1, '\0');
+  from_file.resize(std::fread(from_file.data(), 1, from_file.size(), file));
+  EXPECT_EQ(from_file, expected);
+
+  // same file through the descriptor
+  std::rewind(file);
+#ifdef _WIN32
+  const int fd = _fileno(file);
+#else
+  const int fd = fileno(file);
+#endif
+  json::build_to(fd, {{"strings", json::array(values)}, {"int", 1}}, 300);
+  std::rewind(file);
+  from_file.assign(expected.size() + 1, '\0');
+  from_file.resize(std::fread(from_file.data(), 1, from_file.size(), file));
+  EXPECT_EQ(from_file, expected);
+  std::fclose(file);
+}
+
+TEST(StreamingTests, WriteJsonLines) {
+  std::vector<std::string> writes;
+  const json::sink_function sink = [&writes](std::string_view chunk) { writes.emplace_back(chunk); };
+  {
+    json::lines_options options;
+    options.flush_records = 3;
+    json::lines_writer writer(sink, options);
+    for (int64_t index = 0; index < 7; ++index) {
+      writer.write({{"id", index}});
+    }
+    // failed record leaves nothing behind
+    EXPECT_THROW(writer.write({{"id", json::placeholder(0)}}), std::runtime_error);
+    EXPECT_EQ(writer.pending_records(), 1u);
+    EXPECT_EQ(writer.pending_bytes(), 9u);
+  }
+  // one write per flush, the rest is flushed by the destructor
+  ASSERT_EQ(writes.size(), 3u);
+  EXPECT_EQ(writes[0], "{\"id\":0}\n{\"id\":1}\n{\"id\":2}\n");
+  EXPECT_EQ(writes[1], "{\"id\":3}\n{\"id\":4}\n{\"id\":5}\n");
+  EXPECT_EQ(writes[2], "{\"id\":6}\n");
+
+  // size limit and explicit flush
+  writes.clear();
+  json::lines_options options;
+  options.flush_bytes = 16;
+  json::lines_writer writer(sink, options);
+  writer.write(json::array({1, 2, 3}));
+  EXPECT_TRUE(writes.empty());
+  writer.write(json::array({4, 5, 6}));
+  ASSERT_EQ(writes.size(), 1u);
+  EXPECT_EQ(writes[0], "[1,2,3]\n[4,5,6]\n");
+  writer.write("text");
+  writer.flush();
+  writer.flush();
+  ASSERT_EQ(writes.size(), 2u);
+  EXPECT_EQ(writes[1], "\"text\"\n");
+
+  std::ostringstream stream;
+  {
+    json::lines_writer stream_writer(stream);
+    stream_writer.write({{"a", 1}});
+    stream_writer.write({{"b", 2}});
+    EXPECT_TRUE(stream.str().empty());
+  }
+  EXPECT_EQ(stream.str(), "{\"a\":1}\n{\"b\":2}\n");
+}
+
+TEST(StreamingTests, BuildToPipe) {
+  // output is much larger than the pipe buffer, so the reader must drain it concurrently
+  std::vector<double> values(100000, 0.5);
+  const auto expected = json::build(json::array(values));
+
+  int fds[2];
+#ifdef _WIN32
+  ASSERT_EQ(_pipe(fds, 4096, _O_BINARY), 0);
+#else
+  ASSERT_EQ(pipe(fds), 0);
+#endif
+  std::string received;
+  std::thread reader([&]() {
+    char buffer[4096];
+    for (;;) {
+#ifdef _WIN32
+      const auto bytes = _read(fds[0], buffer, sizeof(buffer));
+#else
+      const auto bytes = read(fds[0], buffer, sizeof(buffer));
+#endif
+      if (bytes <= 0) {
+        break;
+      }
+      received.append(buffer, static_cast<size_t>(bytes));
+    }
+  });
+  json::build_to(fds[1], json::array(values), 4096);
+#ifdef _WIN32
+  _close(fds[1]);
+#else
+  close(fds[1]);
+#endif
+  reader.join();
+#ifdef _WIN32
+  _close(fds[0]);
+#else
+  close(fds[0]);
+#endif
+  EXPECT_EQ(received, expected);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
   InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}